@@ -0,0 +1,43 @@
+#ifndef MC_JSON_COLUMNAR_H
+#define MC_JSON_COLUMNAR_H
+
+#include "micro_json/object.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct MJSColumn MJSColumn;
+
+/*
+ one exported column, rows that are missing the key or hold another type
+ are null: validity bit cleared, zero in data, empty string.
+*/
+struct MJSColumn {
+ void          *data;
+ unsigned int  *offsets;  /* MJS_COLUMN_STRING only, row_count + 1 entries */
+ unsigned char *validity; /* bit (row & 7) of byte (row >> 3) */
+ unsigned int  row_count;
+ unsigned int  null_count;
+ unsigned int  data_size; /* string bytes used */
+ unsigned char type;
+};
+
+MJS_INLINE int MJSColumn_IsValid(const MJSColumn *column, unsigned int row) {
+ return (column->validity[row >> 3] >> (row & 7)) & 1;
+}
+
+/*
+ fill one column per key from an array of objects in a single pass,
+ column_types holds an MJS_COLUMN_TYPE per key. out_columns must be
+ destroyed with MJSColumn_Destroy.
+*/
+MJS_HOT int MJSArray_ExportColumns(MJSArray *arr, MJSStringPool *pool, const MJSKey *keys, const unsigned char *column_types, unsigned int column_count, MJSColumn *out_columns);
+MJS_COLD int MJSColumn_Destroy(MJSColumn *column);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
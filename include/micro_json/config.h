@@ -5,17 +5,29 @@
 */
 
 #define MJS_MAX_POOL_ALLOCATION_BYTES 1024
-#define MJS_MAX_POOL_MEMORY_THRESHOLD 1024
+#define MJS_MAX_POOL_CHUNK_BYTES  (1 << 20)
+#define MJS_MAX_POOL_MEMORY_THRESHOLD 64
 #define MJS_MAX_POOL_CHUNK_NODE   4
+#define MJS_MAX_INTERN_ELEMENTS   64
+#define MJS_MAX_INTERN_STRING_SIZE 16
 
 #define MJS_MAX_RESERVE_BYTES     32
+#define MJS_MAX_STAGING_BYTES     (64 << 10)
+#define MJS_MAX_GATHER_IOV        256
+#define MJS_MIN_GATHER_REF_BYTES  256
 #define MJS_MAX_RESERVE_ELEMENTS  8
 #define MJS_MAX_NESTED_VALUE      20
-#define MJS_MAX_HASH_BUCKETS      8
+#define MJS_MAX_SMALL_OBJECT_PAIRS 8
+#define MJS_MAX_SHAPE_BUCKETS     64
+#define MJS_MAX_BLOCK_CACHE_SIZES 64
 #define MJS_OPTIMAL_ALIGNMENT     16
 
 #define MJS_FORCE_VECTORIZE 
 
 /*
 #define MJS_CUSTOM_OPTIMAL_ALIGNMENT
+*/
+
+/*
+#define MJS_ENABLE_ASYNC_WRITER
 */
\ No newline at end of file
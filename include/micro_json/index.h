@@ -0,0 +1,42 @@
+#ifndef MC_JSON_INDEX_H
+#define MC_JSON_INDEX_H
+
+#include "micro_json/object.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct MJSArrayIndexEntry MJSArrayIndexEntry;
+typedef struct MJSArrayIndex MJSArrayIndex;
+
+struct MJSArrayIndexEntry {
+ MJSDynamicType value;  /* indexed field, int or string */
+ unsigned int   hash;
+ unsigned int   position; /* 0xFFFFFFFF for empty slots */
+};
+
+/*
+ hash index from a field value of the objects in an array to the
+ element position, built in one pass. only int and string values are
+ indexed, the first element wins on duplicates. it keeps no reference to
+ the array, rebuild it after the array changes.
+*/
+struct MJSArrayIndex {
+ MJSArrayIndexEntry *entries;
+ unsigned int       capacity; /* power of two */
+ unsigned int       size;
+};
+
+MJS_COLD int MJSArray_BuildIndex(MJSArray *arr, MJSStringPool *pool, const char *key, MJSArrayIndex *out_index);
+MJS_COLD int MJSArrayIndex_Destroy(MJSArrayIndex *index);
+/* element position, return 0xFFFFFFFF if not found */
+MJS_HOT unsigned int MJSArrayIndex_FindInt(MJSArrayIndex *index, MJS_Int64 value);
+MJS_HOT unsigned int MJSArrayIndex_FindString(MJSArrayIndex *index, MJSStringPool *pool, const char *str, unsigned int str_size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,3 +2,7 @@
 #include "micro_json/token.h"
 #include "micro_json/types.h"
 #include "micro_json/writer.h"
+#include "micro_json/reduce.h"
+#include "micro_json/columnar.h"
+#include "micro_json/index.h"
+#include "micro_json/profile.h"
@@ -11,8 +11,13 @@ extern "C" {
 /*-----------------Forward def-------------------*/
 /* for pointer types */
 typedef struct MJSParsedData MJSParsedData;
+typedef struct MJSParseProfile MJSParseProfile;
 typedef struct MJSStringPool MJSStringPool;
 typedef struct MJSStringPoolNode MJSStringPoolNode;
+typedef struct MJSInternEntry MJSInternEntry;
+typedef struct MJSBlockCache MJSBlockCache;
+typedef struct MJSShape MJSShape;
+typedef struct MJSShapeKey MJSShapeKey;
 typedef struct MJSString MJSString;
 typedef struct MJSInt MJSInt;
 typedef struct MJSFloat MJSFloat;
@@ -24,16 +29,20 @@ typedef union  MJSDynamicType MJSDynamicType;
 typedef struct MJSObjectPair MJSObjectPair;
 typedef struct MJSTokenResult MJSTokenResult;
 typedef struct MJSOutputStreamBuffer MJSOutputStreamBuffer;
+typedef struct MJSKey MJSKey;
 
 /*-----------------Struct Components-------------------*/
 /*
  JSON types
+
+ members are ordered so every value fits in 16 bytes,
+ the type byte always comes first and the widest member last.
 */
 struct MJSString {
  unsigned char  type;
+ unsigned int   chunk_index;
  unsigned int   str_size;
  unsigned int   pool_index;
- unsigned short chunk_index;
 };
 
 
@@ -64,56 +73,96 @@ struct MJSBoolean {
 
 struct MJSStringPool {
  MJSStringPoolNode *root;
- unsigned short node_size;
- unsigned char node_reserve;
+ MJSInternEntry *intern_table;
+ MJSShape **shape_table;
+ MJSBlockCache *block_cache;
+ unsigned int intern_size;
+ unsigned int intern_capacity;
+ unsigned int shape_size;
+ unsigned int shape_capacity;
+ unsigned int node_size;
+ unsigned int node_reserve;
+ unsigned int node_allocated; /* chunks kept by MJSStringPool_Reset */
+ unsigned char options;
 };
 
 struct MJSStringPoolNode {
  char *str;
  unsigned int pool_size;
- unsigned short pool_reserve;
+ unsigned int pool_reserve;
 };
 
 MJS_COLD int MJSStringPool_Init(MJSStringPool *pool);
 MJS_COLD int MJSStringPool_Destroy(MJSStringPool *pool);
-MJS_HOT unsigned short MJSStringPool_GetCurrentNode(MJSStringPool *pool);
+MJS_COLD int MJSStringPool_Reset(MJSStringPool *pool);
+MJS_HOT unsigned int MJSStringPool_GetCurrentNode(MJSStringPool *pool);
 MJS_HOT int MJSStringPool_ExpandNode(MJSStringPoolNode *node, unsigned int additional_size);
-MJS_HOT int MJSStringPool_AddToPool(MJSStringPool *pool, const char *str, unsigned int str_size, unsigned int *out_index, unsigned short *out_chunk_index);
+MJS_HOT int MJSStringPool_AddToPool(MJSStringPool *pool, const char *str, unsigned int str_size, unsigned int *out_index, unsigned int *out_chunk_index);
+
+/* canonical copy of an interned string */
+struct MJSInternEntry {
+ unsigned int   hash;
+ unsigned int   pool_index;
+ unsigned int   str_size;
+ unsigned int   chunk_index;
+};
+
+/*
+ container buffers given back by MJSParserData_Reset, one list of
+ blocks per exact byte size, reused by the next parse on the same pool.
+*/
+struct MJSBlockCache {
+ void         *head;
+ unsigned int bytes;
+};
+
+/* set before parsing, strings added earlier are not interned */
+MJS_COLD int MJSStringPool_SetOptions(MJSStringPool *pool, unsigned char options);
+MJS_HOT int MJSStringPool_Intern(MJSStringPool *pool, unsigned int *pool_index, unsigned int str_size, unsigned int *chunk_index);
 
 /*-----------------Array Container-------------------*/
 struct MJSArray {
  unsigned char  type;
- MJSDynamicType *dynamic_type_ptr;
+ unsigned char  reserve; /* room for 1 << reserve elements, 0 when packed */
+ unsigned char  packed_type;
  unsigned int   size;
- unsigned char  reserve;
+ MJSDynamicType *dynamic_type_ptr; /* raw element buffer when packed */
 };
 
 
 MJS_COLD int MJSArray_Init(MJSArray *arr);
 MJS_COLD int MJSArray_Destroy(MJSArray *arr);
 MJS_HOT int MJSArray_Add(MJSArray *arr, MJSDynamicType *value);
+/* NULL for packed arrays, use MJSArray_GetValue or MJSArray_GetPacked */
 MJS_HOT MJSDynamicType* MJSArray_Get(MJSArray *arr, unsigned int index);
+MJS_HOT int MJSArray_GetValue(MJSArray *arr, unsigned int index, MJSDynamicType *out_value);
 MJS_HOT unsigned int MJSArray_Size(MJSArray *arr);
+MJS_HOT int MJSArray_Pack(MJSArray *arr);
+MJS_HOT const void* MJSArray_GetPacked(MJSArray *arr, unsigned char *out_packed_type);
 
 /*-----------------Object Container-------------------*/
 struct MJSObject {
  unsigned char  type;
- MJSObjectPair  *obj_pair_ptr;
- unsigned int   obj_pair_size;
  unsigned char  reserve;
+ unsigned char  flags;
+ unsigned int   obj_pair_size;
+ MJSObjectPair  *obj_pair_ptr;
 };
 
 
 MJS_COLD int MJSObject_Init(MJSObject *container);
 MJS_COLD int MJSObject_Destroy(MJSObject *container);
-MJS_HOT int MJSObject_InsertFromPool(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned short pool_chunk_index, MJSDynamicType *value);
+MJS_HOT int MJSObject_InsertFromPool(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned int pool_chunk_index, MJSDynamicType *value);
 MJS_HOT int MJSObject_Insert(MJSObject *container, MJSStringPool *pool, const char *key, unsigned int str_size, MJSDynamicType *value);
 MJS_HOT MJSDynamicType* MJSObject_Get(MJSObject *container, MJSStringPool *pool, const char *key, unsigned int str_size);
-MJS_HOT MJSDynamicType* MJSObject_GetFromPool(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned short pool_chunk_index);
+MJS_HOT MJSDynamicType* MJSObject_GetFromPool(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned int pool_chunk_index);
+MJS_HOT unsigned int MJSObject_Size(MJSObject *container);
+/* visit pairs in document order, *iter starts at 0, return 1 per pair and 0 at the end */
+MJS_HOT int MJSObject_Iterate(MJSObject *container, MJSStringPool *pool, unsigned int *iter, const char **out_key, unsigned int *out_key_size, MJSDynamicType **out_value);
 
 
 /*-----------------Types and pair-------------------*/
-/* this simulates a dynamic type */
+/* this simulates a dynamic type, 16 bytes on 64 bit targets */
 union MJSDynamicType {
  unsigned char type;
  MJSString     value_string;
@@ -126,14 +175,56 @@ union MJSDynamicType {
 };
 
 
+/* 32 bytes, two pairs per cache line */
 struct MJSObjectPair {
  MJSDynamicType value;
  unsigned int   key_pool_index;
  unsigned int   key_pool_size;
- unsigned short chunk_node_index;
- unsigned int   next;
+ unsigned int   hash; /* key hash, hashed layout only */
+ unsigned int   chunk_node_index;
+};
+
+
+/*-----------------Precompiled key-------------------*/
+/* key with its hash computed once, the string must outlive the handle */
+struct MJSKey {
+ const char   *str;
+ unsigned int str_size;
+ unsigned int hash;
+};
+
+
+MJS_HOT MJSKey MJSKey_Make(const char *key);
+MJS_HOT MJSKey MJSKey_MakeFromSize(const char *key, unsigned int str_size);
+MJS_HOT MJSDynamicType* MJSObject_GetByKey(MJSObject *container, MJSStringPool *pool, const MJSKey *key);
+MJS_HOT unsigned int MJSObject_GetByKeys(MJSObject *container, MJSStringPool *pool, const MJSKey *keys, unsigned int key_count, MJSDynamicType **out_values);
+
+
+/*-----------------Shapes-------------------*/
+/* key of a shape, same fields as the key part of MJSObjectPair */
+struct MJSShapeKey {
+ unsigned int   key_pool_index;
+ unsigned int   key_pool_size;
+ unsigned int   chunk_node_index;
 };
 
+/*
+ key sequence shared by every object with the same keys in the same order,
+ owned by the string pool.
+*/
+struct MJSShape {
+ MJSShape       *next;
+ MJSShapeKey    *keys;
+ unsigned short *index;
+ unsigned int   hash;
+ unsigned int   key_count;
+ unsigned int   index_mask;
+};
+
+
+MJS_HOT int MJSObject_Share(MJSObject *container, MJSStringPool *pool);
+MJS_HOT MJSShape* MJSObject_GetShape(MJSObject *container);
+
 
 /*-----------------Parsed data object-------------------*/
 /* main container of json parsed data */
@@ -143,12 +234,20 @@ struct MJSParsedData {
  const char *current;
  const char *end;
 
+ MJSParseProfile *profile; /* sizing hints, see profile.h */
+
  unsigned int cl;
+ unsigned int options;
+ unsigned char duplicate_policy;
 };
 
 
 MJS_COLD int MJSParserData_Init(MJSParsedData *parsed_data);
 MJS_COLD int MJSParserData_Destroy(MJSParsedData *parsed_data);
+/* reset before the pool, the containers go back to the pool block cache */
+MJS_COLD int MJSParserData_Reset(MJSParsedData *parsed_data, MJSStringPool *pool);
+MJS_COLD int MJSParserData_SetOptions(MJSParsedData *parsed_data, unsigned int options);
+MJS_COLD int MJSParserData_SetDuplicatePolicy(MJSParsedData *parsed_data, unsigned char policy);
 
 /*-----------------Parsed result-------------------*/
 struct MJSTokenResult {
@@ -157,23 +256,44 @@ struct MJSTokenResult {
 };
 
 /*-----------------Output Stream buffer-------------------*/
+/*
+ memory mode grows buff to hold the whole document, file and fd modes
+ use it as a MJS_MAX_STAGING_BYTES staging buffer. gather mode also
+ keeps an iovec list over staged bytes and referenced memory, async
+ mode swaps buff with a second one that a flush thread writes out.
+ memory and fixed buffers are NUL terminated on flush.
+*/
 struct MJSOutputStreamBuffer {
  FILE           *file_ptr;
  char           *buff;
  char           *cache;
+ void           *iov;
+ void           *async;
+ int            fd;
+ unsigned int   iov_count;
  
  unsigned int   buff_size;
 
  unsigned int   cache_size;
  unsigned int   cache_allocated_size;
- unsigned short buff_reserve;
+ unsigned int   buff_reserve;
  unsigned char  mode;
 };
 
 
 MJS_COLD int MJSOutputStreamBuffer_Init(MJSOutputStreamBuffer *buff, unsigned char mode, FILE *fp);
+MJS_COLD int MJSOutputStreamBuffer_InitFd(MJSOutputStreamBuffer *buff, int fd);
+MJS_COLD int MJSOutputStreamBuffer_InitFdGather(MJSOutputStreamBuffer *buff, int fd);
+MJS_COLD int MJSOutputStreamBuffer_InitFdAsync(MJSOutputStreamBuffer *buff, int fd);
+/* arr_size counts the terminating NUL, MJS_RESULT_BUFFER_TOO_SMALL once arr is full */
+MJS_COLD int MJSOutputStreamBuffer_InitFixed(MJSOutputStreamBuffer *buff, char *arr, unsigned int arr_size);
 MJS_COLD int MJSOutputStreamBuffer_Destroy(MJSOutputStreamBuffer *buff);
+MJS_COLD int MJSOutputStreamBuffer_Reset(MJSOutputStreamBuffer *buff);
+/* memory mode room for size more bytes, other modes ignore it */
+MJS_COLD int MJSOutputStreamBuffer_Reserve(MJSOutputStreamBuffer *buff, unsigned int size);
 MJS_HOT int MJSOutputStreamBuffer_Write(MJSOutputStreamBuffer *buff, char *arr, unsigned int arr_size);
+/* gather mode keeps a pointer to arr until the next flush, other modes copy it */
+MJS_HOT int MJSOutputStreamBuffer_WriteRef(MJSOutputStreamBuffer *buff, const char *arr, unsigned int arr_size);
 MJS_HOT int MJSOutputStreamBuffer_Flush(MJSOutputStreamBuffer *buff);
 MJS_HOT int MJSOutputStreamBuffer_ExpandCache(MJSOutputStreamBuffer *buff);
 
@@ -0,0 +1,51 @@
+#ifndef MC_JSON_PROFILE_H
+#define MC_JSON_PROFILE_H
+
+#include "micro_json/object.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct MJSParseProfileLevel MJSParseProfileLevel;
+
+/*
+ sizes seen at one nesting depth, the hints are a running average
+ over parses, the totals and counts only live during a parse.
+*/
+struct MJSParseProfileLevel {
+ unsigned int array_size;  /* hint, elements per array */
+ unsigned int object_size; /* hint, pairs per object */
+ unsigned int array_total;
+ unsigned int array_count;
+ unsigned int object_total;
+ unsigned int object_count;
+};
+
+/*
+ learned from every successful parse of a MJSParsedData it is set on,
+ later parses pre-size arrays, objects and the first pool chunk from it.
+ one profile per message schema, it is not thread safe.
+*/
+struct MJSParseProfile {
+ MJSParseProfileLevel levels[MJS_MAX_NESTED_VALUE + 1];
+ unsigned int pool_bytes; /* hint, string bytes per document */
+ unsigned int parse_count;
+};
+
+MJS_COLD int MJSParseProfile_Init(MJSParseProfile *profile);
+/* NULL turns profiling off */
+MJS_COLD int MJSParserData_SetProfile(MJSParsedData *parsed_data, MJSParseProfile *profile);
+/*
+ called by MJS_TokenParse. begin clears the totals and grows an empty
+ pool to the pool_bytes hint, learn folds a successful parse into the hints.
+*/
+MJS_COLD int MJSParseProfile_Begin(MJSParseProfile *profile, MJSStringPool *pool);
+MJS_COLD int MJSParseProfile_Learn(MJSParseProfile *profile, MJSStringPool *pool);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MC_JSON_REDUCE_H
+#define MC_JSON_REDUCE_H
+
+#include "micro_json/object.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* out_counts size for MJSArray_ReduceCountByType, indexed by MJS_TYPE */
+#define MJS_REDUCE_TYPE_SLOTS (MJS_TYPE_NUMBER_DOUBLE + 1)
+
+/*
+ numeric reductions over int, float and double elements,
+ other element types are skipped. packed arrays and unpacked arrays
+ holding a single number type take a vector path, mixed ones a scalar loop.
+ min, max and mean return MJS_RESULT_INVALID_TYPE when there is no number.
+*/
+MJS_HOT int MJSArray_ReduceSum(MJSArray *arr, double *out_sum);
+MJS_HOT int MJSArray_ReduceMin(MJSArray *arr, double *out_min);
+MJS_HOT int MJSArray_ReduceMax(MJSArray *arr, double *out_max);
+MJS_HOT int MJSArray_ReduceMean(MJSArray *arr, double *out_mean);
+MJS_HOT int MJSArray_ReduceCountByType(MJSArray *arr, unsigned int out_counts[MJS_REDUCE_TYPE_SLOTS]);
+/* both arrays must have the same size and hold numbers only */
+MJS_HOT int MJSArray_ReduceDot(MJSArray *a, MJSArray *b, double *out_dot);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
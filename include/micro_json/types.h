@@ -18,7 +18,11 @@
 typedef long long MJS_Int64;
 typedef unsigned long long MJS_Uint64;
 
+/* bit scans, x must not be 0 */
 #define MJS_CountTrailingZeroes __builtin_ctz
+#define MJS_CountTrailingZeroes64 __builtin_ctzll
+#define MJS_CountLeadingZeroes __builtin_clz
+#define MJS_CountLeadingZeroes64 __builtin_clzll
 
 #elif defined(_MSC_VER)
 
@@ -29,13 +33,10 @@ typedef unsigned long long MJS_Uint64;
 
 #define MJS_INLINE static __forceinline
 
-typedef __int64 MJS_Int64;
-typedef __uint64 MJS_Uint64;
+#include <intrin.h>
 
-/* Bruijn algoritm */
-MJS_INLINE unsigned short MJS_CountTrailingZeroes(unsigned short x) {
- return (unsigned short)mjs__bruijin_numbers[((x & -x) * 0x077CB531u) >> 27];
-}
+typedef __int64 MJS_Int64;
+typedef unsigned __int64 MJS_Uint64;
 
 #else
 
@@ -49,11 +50,86 @@ typedef unsigned long int MJS_Uint64;
 
 #define MJS_INLINE static
 
+#endif
+
 
+/*
+ bit scans for compilers without the builtins, x must not be 0
+*/
+#if !defined(__GNUC__) && !defined(__clang__)
+
+extern const unsigned char mjs__bruijin_numbers[32];
+extern const unsigned char mjs__bruijin_numbers64[64];
+
+/* Bruijn algoritm */
 MJS_INLINE unsigned short MJS_CountTrailingZeroes(unsigned short x) {
  return (unsigned short)mjs__bruijin_numbers[((x & -x) * 0x077CB531u) >> 27];
 }
 
+#if defined(_MSC_VER)
+
+MJS_INLINE unsigned int MJS_CountTrailingZeroes64(MJS_Uint64 x) {
+ unsigned long n;
+#if defined(_M_X64) || defined(_M_ARM64)
+ _BitScanForward64(&n, x);
+#else
+ if(!_BitScanForward(&n, (unsigned long)x)) {
+  _BitScanForward(&n, (unsigned long)(x >> 32));
+  n += 32;
+ }
+#endif
+ return (unsigned int)n;
+}
+
+MJS_INLINE unsigned int MJS_CountLeadingZeroes(unsigned int x) {
+ unsigned long n;
+ _BitScanReverse(&n, x);
+ return 31 - (unsigned int)n;
+}
+
+MJS_INLINE unsigned int MJS_CountLeadingZeroes64(MJS_Uint64 x) {
+ unsigned long n;
+#if defined(_M_X64) || defined(_M_ARM64)
+ _BitScanReverse64(&n, x);
+#else
+ if(_BitScanReverse(&n, (unsigned long)(x >> 32)))
+  n += 32;
+ else
+  _BitScanReverse(&n, (unsigned long)x);
+#endif
+ return 63 - (unsigned int)n;
+}
+
+#else
+
+MJS_INLINE unsigned int MJS_CountTrailingZeroes64(MJS_Uint64 x) {
+ return mjs__bruijin_numbers64[((x & (0 - x)) * 0x03F79D71B4CB0A89ull) >> 58];
+}
+
+/* top bit kept alone after smearing it down, then the same tables */
+MJS_INLINE unsigned int MJS_CountLeadingZeroes(unsigned int x) {
+ x |= x >> 1;
+ x |= x >> 2;
+ x |= x >> 4;
+ x |= x >> 8;
+ x |= x >> 16;
+ x ^= x >> 1;
+ return 31 - mjs__bruijin_numbers[((x * 0x077CB531u) & 0xFFFFFFFFu) >> 27];
+}
+
+MJS_INLINE unsigned int MJS_CountLeadingZeroes64(MJS_Uint64 x) {
+ x |= x >> 1;
+ x |= x >> 2;
+ x |= x >> 4;
+ x |= x >> 8;
+ x |= x >> 16;
+ x |= x >> 32;
+ x ^= x >> 1;
+ return 63 - mjs__bruijin_numbers64[(x * 0x03F79D71B4CB0A89ull) >> 58];
+}
+
+#endif
+
 #endif
 
 
@@ -72,12 +148,83 @@ typedef enum {
  MJS_TYPE_NUMBER_DOUBLE = 8,
 } MJS_TYPE;
 
+/*
+ element type of a packed array
+*/
+typedef enum {
+ MJS_PACKED_NONE = 0,
+ MJS_PACKED_INT64 = 1,   /* MJS_Int64[size] */
+ MJS_PACKED_FLOAT = 2,   /* float[size] */
+ MJS_PACKED_DOUBLE = 3,  /* double[size] */
+ MJS_PACKED_BOOLEAN = 4, /* unsigned char[size] */
+} MJS_PACKED_TYPE;
+
+/*
+ parse options
+*/
+typedef enum {
+ MJS_PARSE_PACK_ARRAYS = 1, /* store homogeneous number/boolean arrays packed */
+ MJS_PARSE_DEFER_INDEX = 2, /* index large objects on their first lookup, only with MJS_DUPLICATE_KEY_NO_CHECK */
+} MJS_PARSE_OPTION;
+
+/*
+ what a parse does with a key repeated in one object
+*/
+typedef enum {
+ MJS_DUPLICATE_KEY_ERROR = 0,      /* fail with MJS_RESULT_DUPLICATE_KEY */
+ MJS_DUPLICATE_KEY_LAST_WINS = 1,  /* keep the last value, at the first position */
+ MJS_DUPLICATE_KEY_FIRST_WINS = 2, /* keep the first value */
+ MJS_DUPLICATE_KEY_NO_CHECK = 3,   /* trusted input, keys are not compared and repeats are all kept, lets MJS_PARSE_DEFER_INDEX defer */
+} MJS_DUPLICATE_KEY_POLICY;
+
+/*
+ column buffer types for MJSArray_ExportColumns
+*/
+typedef enum {
+ MJS_COLUMN_INT64 = 1,   /* MJS_Int64[row_count], int values only */
+ MJS_COLUMN_DOUBLE = 2,  /* double[row_count], any number converts */
+ MJS_COLUMN_BOOLEAN = 3, /* unsigned char[row_count] */
+ MJS_COLUMN_STRING = 4,  /* bytes, row i is data[offsets[i] .. offsets[i + 1]) */
+} MJS_COLUMN_TYPE;
+
+/*
+ object layout flags
+*/
+typedef enum {
+ MJS_OBJECT_SMALL = 1,  /* dense pairs, linear scan, no hash buckets */
+ MJS_OBJECT_SHAPED = 2, /* value array only, keys live in a shared MJSShape */
+ MJS_OBJECT_UNINDEXED = 4, /* dense pairs without hashes or index yet */
+} MJS_OBJECT_FLAG;
+
+/*
+ string pool options
+*/
+typedef enum {
+ MJS_POOL_INTERN_KEYS = 1,    /* deduplicate object keys */
+ MJS_POOL_INTERN_STRINGS = 2, /* deduplicate string values up to MJS_MAX_INTERN_STRING_SIZE */
+ MJS_POOL_SHARE_SHAPES = 4,   /* objects with the same key sequence share one MJSShape */
+} MJS_POOL_OPTION;
+
+/*
+ writer options
+*/
+typedef enum {
+ MJS_WRITER_COMPACT = 1, /* no whitespace at all, ':' and ',' only */
+ MJS_WRITER_CRLF = 2,    /* pretty lines end with "\r\n" */
+ MJS_WRITER_ASCII_ONLY = 4, /* non ascii is written as \u escapes, utf-8 is copied as is otherwise */
+} MJS_WRITER_OPTION;
+
 /*
  write mode
 */
 typedef enum {
  MJS_WRITE_TO_MEMORY_BUFFER = 1,
  MJS_WRITE_TO_FILE = 2,
+ MJS_WRITE_TO_FD = 3, /* write(2) on a file descriptor, posix only */
+ MJS_WRITE_TO_FD_GATHER = 4, /* writev(2), long strings are not copied, posix only */
+ MJS_WRITE_TO_FIXED_BUFFER = 5, /* caller owned buffer, never grows */
+ MJS_WRITE_TO_COUNTER = 6, /* nothing is kept, buff_size counts the bytes */
+ MJS_WRITE_TO_FD_ASYNC = 7, /* write(2) from a flush thread, needs MJS_ENABLE_ASYNC_WRITER */
 } MJS_WRITE_MODE;
 /*
  error defs
@@ -101,6 +248,7 @@ typedef enum {
  MJS_RESULT_TOO_SMALL_NUMBER = -15,
  MJS_RESULT_INVALID_STRING_CHARACTER = -16,
  MJS_RESULT_INVALID_NUMBER_TYPE = -17,
+ MJS_RESULT_BUFFER_TOO_SMALL = -18,
 } MJS_RESULT;
 
 
@@ -131,7 +279,7 @@ MJS_INLINE const char* MJS_CodeToString(signed char code) {
   case MJS_RESULT_EMPTY_KEY:
    return "MJS_RESULT_EMPTY_KEY";
   break;
-  case MJS_RESULT_DUPLICATE_KEY: /* currently skipped */
+  case MJS_RESULT_DUPLICATE_KEY:
    return "MJS_RESULT_DUPLICATE_KEY";
   break;
   case MJS_RESULT_INCOMPLETE_STRING_SYNTAX:
@@ -161,6 +309,9 @@ MJS_INLINE const char* MJS_CodeToString(signed char code) {
   case MJS_RESULT_INVALID_NUMBER_TYPE:
    return "MJS_RESULT_INVALID_NUMBER_TYPE";
   break;
+  case MJS_RESULT_BUFFER_TOO_SMALL:
+   return "MJS_RESULT_BUFFER_TOO_SMALL";
+  break;
  }
  return "Unknown Error";
 }
@@ -7,8 +7,52 @@
 extern "C" {
 #endif
 
+typedef struct MJSWriterOptions MJSWriterOptions;
+typedef struct MJSWriter MJSWriter;
 
+/*
+ output style, MJSWriterOptions_Init gives the MJSWriter_Serialize one
+*/
+struct MJSWriterOptions {
+ unsigned int flags;        /* MJS_WRITER_OPTION */
+ unsigned int indent_width; /* spaces per nesting level, pretty only */
+};
+
+
+MJS_COLD int MJSWriterOptions_Init(MJSWriterOptions *options);
 MJS_COLD int MJSWriter_Serialize(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *container);
+MJS_COLD int MJSWriter_SerializeWithOptions(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *container, const MJSWriterOptions *options);
+/* exact byte count SerializeWithOptions would write, for MJSOutputStreamBuffer_Reserve or InitFixed */
+MJS_COLD int MJSWriter_MeasureSize(MJSStringPool *pool, MJSDynamicType *container, const MJSWriterOptions *options, unsigned int *out_size);
+
+/*-----------------Streaming writer-------------------*/
+/*
+ emits one value straight into buff, no tree is built. commas and
+ indentation follow the same layout as MJSWriter_SerializeWithOptions.
+ calls out of place, like a key in an array or a value without key,
+ return MJS_RESULT_UNEXPECTED_TOKEN.
+*/
+struct MJSWriter {
+ MJSOutputStreamBuffer *buff;
+ MJSWriterOptions      options;
+ unsigned int          depth;
+ unsigned char         levels[MJS_MAX_NESTED_VALUE + 1]; /* state of every open container */
+};
+
+
+MJS_COLD int MJSWriter_Init(MJSWriter *writer, MJSOutputStreamBuffer *buff, const MJSWriterOptions *options);
+MJS_HOT int MJSWriter_BeginObject(MJSWriter *writer);
+MJS_HOT int MJSWriter_EndObject(MJSWriter *writer);
+MJS_HOT int MJSWriter_BeginArray(MJSWriter *writer);
+MJS_HOT int MJSWriter_EndArray(MJSWriter *writer);
+MJS_HOT int MJSWriter_Key(MJSWriter *writer, const char *key, unsigned int key_size);
+MJS_HOT int MJSWriter_String(MJSWriter *writer, const char *str, unsigned int str_size);
+MJS_HOT int MJSWriter_Int(MJSWriter *writer, MJS_Int64 value);
+MJS_HOT int MJSWriter_Double(MJSWriter *writer, double value);
+MJS_HOT int MJSWriter_Boolean(MJSWriter *writer, int value);
+MJS_HOT int MJSWriter_Null(MJSWriter *writer);
+/* the root value must be complete, flushes buff */
+MJS_COLD int MJSWriter_Finish(MJSWriter *writer);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,186 @@
+#include "micro_json/columnar.h"
+#include "micro_json/object_impl.h"
+
+/*-----------------Static func-------------------*/
+
+/*
+ allocate buffers for row_count rows, every row starts as null
+*/
+static MJS_COLD int column_init(MJSColumn *column, unsigned char type, unsigned int row_count) {
+ unsigned int data_size;
+ memset(column, 0, sizeof(MJSColumn));
+ column->type = type;
+ column->row_count = row_count;
+ column->null_count = row_count;
+
+ switch(type) {
+  case MJS_COLUMN_INT64:
+   data_size = sizeof(MJS_Int64) * row_count;
+  break;
+  case MJS_COLUMN_DOUBLE:
+   data_size = sizeof(double) * row_count;
+  break;
+  case MJS_COLUMN_BOOLEAN:
+   data_size = row_count;
+  break;
+  case MJS_COLUMN_STRING:
+   /* rough guess, grows on demand */
+   data_size = MJS_MAX_RESERVE_BYTES + row_count * 8;
+   column->offsets = (unsigned int*)__aligned_alloc(sizeof(unsigned int) * (row_count + 1));
+   if(MJS_Unlikely(!column->offsets))
+    return MJS_RESULT_ALLOCATION_FAILED;
+   column->offsets[0] = 0;
+  break;
+  default:
+   return MJS_RESULT_INVALID_TYPE;
+ }
+
+ column->data = __aligned_alloc(data_size + 1);
+ column->validity = (unsigned char*)__aligned_alloc((row_count >> 3) + 1);
+ if(MJS_Unlikely(!column->data || !column->validity))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ if(type != MJS_COLUMN_STRING)
+  memset(column->data, 0, data_size);
+ else
+  column->data_size = data_size; /* capacity until the export is done */
+ memset(column->validity, 0, (row_count >> 3) + 1);
+ return 0;
+}
+
+/*
+ store row value, or leave it null when the type does not fit the column
+*/
+MJS_INLINE int column_set(MJSColumn *column, MJSStringPool *pool, unsigned int row, const MJSDynamicType *value, unsigned int *string_end) {
+ unsigned int str_size;
+ char *data;
+ int valid = 0;
+
+ if(value) {
+  switch(column->type) {
+   case MJS_COLUMN_INT64:
+    if(value->type == MJS_TYPE_NUMBER_INT) {
+     ((MJS_Int64*)column->data)[row] = value->value_int.value;
+     valid = 1;
+    }
+   break;
+   case MJS_COLUMN_DOUBLE:
+    valid = 1;
+    if(value->type == MJS_TYPE_NUMBER_DOUBLE)
+     ((double*)column->data)[row] = value->value_double.value;
+    else if(value->type == MJS_TYPE_NUMBER_FLOAT)
+     ((double*)column->data)[row] = (double)value->value_float.value;
+    else if(value->type == MJS_TYPE_NUMBER_INT)
+     ((double*)column->data)[row] = (double)value->value_int.value;
+    else
+     valid = 0;
+   break;
+   case MJS_COLUMN_BOOLEAN:
+    if(value->type == MJS_TYPE_BOOLEAN) {
+     ((unsigned char*)column->data)[row] = value->value_boolean.value;
+     valid = 1;
+    }
+   break;
+   case MJS_COLUMN_STRING:
+    if(value->type == MJS_TYPE_STRING) {
+     str_size = value->value_string.str_size;
+     if(MJS_Unlikely(*string_end + str_size > column->data_size)) {
+      column->data_size = (column->data_size << 1) + str_size;
+      data = (char*)__aligned_realloc(column->data, column->data_size + 1);
+      if(MJS_Unlikely(!data))
+       return MJS_RESULT_ALLOCATION_FAILED;
+      column->data = data;
+     }
+     memcpy((char*)column->data + *string_end, &pool->root[value->value_string.chunk_index].str[value->value_string.pool_index], str_size);
+     *string_end += str_size;
+     valid = 1;
+    }
+   break;
+  }
+ }
+
+ if(column->type == MJS_COLUMN_STRING)
+  column->offsets[row + 1] = *string_end;
+ column->validity[row >> 3] |= (unsigned char)(valid << (row & 7));
+ column->null_count -= valid;
+ return 0;
+}
+
+/*-----------------Columnar func-------------------*/
+
+MJS_HOT int MJSArray_ExportColumns(MJSArray *arr, MJSStringPool *pool, const MJSKey *keys, const unsigned char *column_types, unsigned int column_count, MJSColumn *out_columns) {
+ MJSDynamicType **values;
+ unsigned int *string_ends, *shape_slots;
+ MJSShape *last_shape = NULL;
+ MJSDynamicType *row;
+ unsigned int i, c;
+ int result = 0;
+
+ if(MJS_Unlikely(!arr || !pool || !keys || !column_types || !out_columns))
+  return MJS_RESULT_NULL_POINTER;
+ if(MJS_Unlikely(arr->packed_type))
+  return MJS_RESULT_INVALID_TYPE;
+
+ for(c = 0; c < column_count; c++)
+  memset(&out_columns[c], 0, sizeof(MJSColumn));
+
+ /* values, string write positions and per shape slots share one block */
+ values = (MJSDynamicType**)__aligned_alloc((sizeof(MJSDynamicType*) + sizeof(unsigned int) * 2) * (column_count + 1));
+ if(MJS_Unlikely(!values))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ string_ends = (unsigned int*)&values[column_count + 1];
+ shape_slots = &string_ends[column_count + 1];
+
+ for(c = 0; c < column_count && !result; c++) {
+  result = column_init(&out_columns[c], column_types[c], arr->size);
+  string_ends[c] = 0;
+ }
+
+ for(i = 0; i < arr->size && !result; i++) {
+  row = &arr->dynamic_type_ptr[i];
+
+  if(row->type != MJS_TYPE_OBJECT) {
+   for(c = 0; c < column_count; c++)
+    values[c] = NULL;
+  } else if(row->value_object.flags & MJS_OBJECT_SHAPED) {
+   /* records with the same keys resolve each column once per shape */
+   MJSShape *shape = shaped_object_shape(&row->value_object);
+   MJSDynamicType *shape_values = shaped_object_values(&row->value_object);
+   if(shape != last_shape) {
+    for(c = 0; c < column_count; c++)
+     shape_slots[c] = shape_find(shape, pool, keys[c].str, keys[c].str_size, keys[c].hash);
+    last_shape = shape;
+   }
+   for(c = 0; c < column_count; c++)
+    values[c] = (shape_slots[c] != 0xFFFFFFFF) ? &shape_values[shape_slots[c]] : NULL;
+  } else {
+   MJSObject_GetByKeys_IMPL(&row->value_object, pool, keys, column_count, values);
+  }
+
+  for(c = 0; c < column_count && !result; c++)
+   result = column_set(&out_columns[c], pool, i, values[c], &string_ends[c]);
+ }
+
+ for(c = 0; c < column_count; c++) {
+  if(out_columns[c].type == MJS_COLUMN_STRING)
+   out_columns[c].data_size = string_ends[c];
+  if(MJS_Unlikely(result))
+   MJSColumn_Destroy(&out_columns[c]);
+ }
+
+ __aligned_dealloc(values);
+ return result;
+}
+
+
+MJS_COLD int MJSColumn_Destroy(MJSColumn *column) {
+ if(MJS_Unlikely(!column))
+  return MJS_RESULT_NULL_POINTER;
+ if(column->data)
+  __aligned_dealloc(column->data);
+ if(column->offsets)
+  __aligned_dealloc(column->offsets);
+ if(column->validity)
+  __aligned_dealloc(column->validity);
+ memset(column, 0, sizeof(MJSColumn));
+ return 0;
+}
@@ -0,0 +1,125 @@
+#include "micro_json/index.h"
+#include "micro_json/object_impl.h"
+
+/*-----------------Static func-------------------*/
+
+MJS_INLINE unsigned int index_int_hash(MJS_Int64 value) {
+ return (unsigned int)(((MJS_Uint64)value * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+
+MJS_INLINE const char* index_string(MJSStringPool *pool, const MJSDynamicType *value) {
+ return &pool->root[value->value_string.chunk_index].str[value->value_string.pool_index];
+}
+
+/*
+ slot holding value, or the empty slot where it belongs
+*/
+MJS_INLINE unsigned int index_probe_int(MJSArrayIndex *index, MJS_Int64 value, unsigned int hash) {
+ const unsigned int mask = index->capacity - 1;
+ unsigned int i = hash & mask;
+ MJSArrayIndexEntry *entry;
+ for(;; i = (i + 1) & mask) {
+  entry = &index->entries[i];
+  if(entry->position == 0xFFFFFFFF)
+   return i;
+  if(entry->hash == hash && entry->value.type == MJS_TYPE_NUMBER_INT && entry->value.value_int.value == value)
+   return i;
+ }
+}
+
+
+MJS_INLINE unsigned int index_probe_string(MJSArrayIndex *index, MJSStringPool *pool, const char *str, unsigned int str_size, unsigned int hash) {
+ const unsigned int mask = index->capacity - 1;
+ unsigned int i = hash & mask;
+ MJSArrayIndexEntry *entry;
+ for(;; i = (i + 1) & mask) {
+  entry = &index->entries[i];
+  if(entry->position == 0xFFFFFFFF)
+   return i;
+  if(entry->hash == hash && entry->value.type == MJS_TYPE_STRING && entry->value.value_string.str_size == str_size &&
+     !memcmp(index_string(pool, &entry->value), str, str_size))
+   return i;
+ }
+}
+
+/*-----------------Index func-------------------*/
+
+MJS_COLD int MJSArray_BuildIndex(MJSArray *arr, MJSStringPool *pool, const char *key, MJSArrayIndex *out_index) {
+ MJSDynamicType *value;
+ MJSArrayIndexEntry *entry;
+ MJSKey field;
+ unsigned int i, slot, hash;
+
+ if(MJS_Unlikely(!arr || !pool || !key || !out_index))
+  return MJS_RESULT_NULL_POINTER;
+ if(MJS_Unlikely(arr->packed_type))
+  return MJS_RESULT_INVALID_TYPE;
+
+ /* load factor stays under 1/2 */
+ out_index->size = 0;
+ out_index->capacity = MJS_MAX_RESERVE_ELEMENTS;
+ while(out_index->capacity < (arr->size << 1))
+  out_index->capacity <<= 1;
+ out_index->entries = (MJSArrayIndexEntry*)__aligned_alloc(sizeof(MJSArrayIndexEntry) * out_index->capacity);
+ if(MJS_Unlikely(!out_index->entries))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ memset(out_index->entries, 0xFF, sizeof(MJSArrayIndexEntry) * out_index->capacity);
+
+ field = MJSKey_Make_IMPL(key, strlen(key));
+ for(i = 0; i < arr->size; i++) {
+  if(arr->dynamic_type_ptr[i].type != MJS_TYPE_OBJECT)
+   continue;
+  value = MJSObject_GetByKey_IMPL(&arr->dynamic_type_ptr[i].value_object, pool, &field);
+  if(!value)
+   continue;
+
+  switch(value->type) {
+   case MJS_TYPE_NUMBER_INT:
+    hash = index_int_hash(value->value_int.value);
+    slot = index_probe_int(out_index, value->value_int.value, hash);
+   break;
+   case MJS_TYPE_STRING:
+    hash = generate_hash(index_string(pool, value), value->value_string.str_size);
+    slot = index_probe_string(out_index, pool, index_string(pool, value), value->value_string.str_size, hash);
+   break;
+   default:
+    continue;
+  }
+
+  entry = &out_index->entries[slot];
+  if(entry->position != 0xFFFFFFFF)
+   continue;
+  entry->value = *value;
+  entry->hash = hash;
+  entry->position = i;
+  out_index->size++;
+ }
+ return 0;
+}
+
+
+MJS_COLD int MJSArrayIndex_Destroy(MJSArrayIndex *index) {
+ if(MJS_Unlikely(!index))
+  return MJS_RESULT_NULL_POINTER;
+ if(index->entries)
+  __aligned_dealloc(index->entries);
+ index->entries = NULL;
+ index->capacity = 0;
+ index->size = 0;
+ return 0;
+}
+
+
+MJS_HOT unsigned int MJSArrayIndex_FindInt(MJSArrayIndex *index, MJS_Int64 value) {
+ if(MJS_Unlikely(!index || !index->entries))
+  return 0xFFFFFFFF;
+ return index->entries[index_probe_int(index, value, index_int_hash(value))].position;
+}
+
+
+MJS_HOT unsigned int MJSArrayIndex_FindString(MJSArrayIndex *index, MJSStringPool *pool, const char *str, unsigned int str_size) {
+ if(MJS_Unlikely(!index || !index->entries || !pool || !str))
+  return 0xFFFFFFFF;
+ return index->entries[index_probe_string(index, pool, str, str_size, generate_hash(str, str_size))].position;
+}
@@ -0,0 +1,377 @@
+#include "micro_json/number_format.h"
+#include <string.h>
+
+/*
+ grisu2, Loitsch "Printing Floating-Point Numbers Quickly and Accurately
+ with Integers". values are scaled by a cached power of ten into a 64 bit
+ window, then digits are generated until they fall inside the rounding
+ boundaries of the value.
+*/
+
+typedef struct MJSDiyFp MJSDiyFp;
+
+struct MJSDiyFp {
+ MJS_Uint64 f;
+ int        e;
+};
+
+/* normalized 10^k for k = -348, -340, ..., 340 */
+static const MJS_Uint64 mjs__cached_powers_f[87] = {
+ 0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull, 0xcf42894a5dce35eaull,
+ 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull, 0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full,
+ 0xbe5691ef416bd60cull, 0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+ 0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull, 0xc21094364dfb5637ull,
+ 0x9096ea6f3848984full, 0xd77485cb25823ac7ull, 0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull,
+ 0xb23867fb2a35b28eull, 0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+ 0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull, 0xb5b5ada8aaff80b8ull,
+ 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull, 0x964e858c91ba2655ull, 0xdff9772470297ebdull,
+ 0xa6dfbd9fb8e5b88full, 0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+ 0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull, 0xaa242499697392d3ull,
+ 0xfd87b5f28300ca0eull, 0xbce5086492111aebull, 0x8cbccc096f5088ccull, 0xd1b71758e219652cull,
+ 0x9c40000000000000ull, 0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+ 0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull, 0x9f4f2726179a2245ull,
+ 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull, 0x83c7088e1aab65dbull, 0xc45d1df942711d9aull,
+ 0x924d692ca61be758ull, 0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+ 0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull, 0x952ab45cfa97a0b3ull,
+ 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull, 0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull,
+ 0x88fcf317f22241e2ull, 0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+ 0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull, 0x8bab8eefb6409c1aull,
+ 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull, 0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull,
+ 0x80444b5e7aa7cf85ull, 0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+ 0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull
+};
+
+static const short mjs__cached_powers_e[87] = {
+ -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+ -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+ -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+ -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+ -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+ 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+ 375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+ 641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+ 907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const MJS_Uint64 mjs__pow10_u64[20] = {
+ 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull,
+ 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull, 100000000000000ull,
+ 1000000000000000ull, 10000000000000000ull, 100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+};
+
+/* digit count thresholds, the 0 makes a zero one digit long */
+static const unsigned int mjs__digit_count_u32[10] = {
+ 0u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u
+};
+
+static const char mjs__digit_pairs[201] =
+ "00010203040506070809"
+ "10111213141516171819"
+ "20212223242526272829"
+ "30313233343536373839"
+ "40414243444546474849"
+ "50515253545556575859"
+ "60616263646566676869"
+ "70717273747576777879"
+ "80818283848586878889"
+ "90919293949596979899";
+
+/*-----------------Static func-------------------*/
+
+/*
+ decimal length from the bit length, 1233 / 4096 ~ log10(2)
+*/
+MJS_INLINE unsigned int count_digits32(unsigned int v) {
+ const unsigned int t = ((32 - MJS_CountLeadingZeroes(v | 1)) * 1233) >> 12;
+ return t + 1 - (v < mjs__digit_count_u32[t]);
+}
+
+
+MJS_INLINE unsigned int count_digits64(MJS_Uint64 v) {
+ const unsigned int t = ((64 - MJS_CountLeadingZeroes64(v | 1)) * 1233) >> 12;
+ return t + 1 - (v < mjs__pow10_u64[t] && t);
+}
+
+/*
+ digits are written back to front, two per division
+*/
+MJS_INLINE unsigned int format_u32(unsigned int v, char *out) {
+ const unsigned int length = count_digits32(v);
+ char *p = out + length;
+ while(v >= 100) {
+  const unsigned int i = (v % 100) << 1;
+  v /= 100;
+  p -= 2;
+  memcpy(p, &mjs__digit_pairs[i], 2);
+ }
+ if(v >= 10)
+  memcpy(p - 2, &mjs__digit_pairs[v << 1], 2);
+ else
+  p[-1] = (char)('0' + v);
+ return length;
+}
+
+
+MJS_INLINE unsigned int format_u64(MJS_Uint64 v, char *out) {
+ unsigned int length;
+ char *p;
+ if(v <= 0xFFFFFFFFu)
+  return format_u32((unsigned int)v, out);
+ length = count_digits64(v);
+ p = out + length;
+ /* 64 bit divisions until the rest fits in 32 bits */
+ while(v > 0xFFFFFFFFu) {
+  const unsigned int i = (unsigned int)(v % 100) << 1;
+  v /= 100;
+  p -= 2;
+  memcpy(p, &mjs__digit_pairs[i], 2);
+ }
+ format_u32((unsigned int)v, out);
+ return length;
+}
+
+
+MJS_INLINE MJSDiyFp diyfp_make(MJS_Uint64 f, int e) {
+ MJSDiyFp out;
+ out.f = f;
+ out.e = e;
+ return out;
+}
+
+
+MJS_INLINE MJSDiyFp diyfp_normalize(MJSDiyFp x) {
+ const unsigned int shift = MJS_CountLeadingZeroes64(x.f);
+ return diyfp_make(x.f << shift, x.e - (int)shift);
+}
+
+/*
+ upper 64 bits of the product, rounded
+*/
+MJS_INLINE MJSDiyFp diyfp_mul(MJSDiyFp x, MJSDiyFp y) {
+ const MJS_Uint64 a = x.f >> 32, b = x.f & 0xFFFFFFFFu;
+ const MJS_Uint64 c = y.f >> 32, d = y.f & 0xFFFFFFFFu;
+ const MJS_Uint64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+ MJS_Uint64 mid = (bd >> 32) + (ad & 0xFFFFFFFFu) + (bc & 0xFFFFFFFFu);
+ mid += 1u << 31;
+ return diyfp_make(ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64);
+}
+
+/*
+ cached power c = 10^-k whose product with a value of exponent e
+ lands in [-60, -32], k goes to *K
+*/
+MJS_INLINE MJSDiyFp cached_power(int e, int *K) {
+ const double dk = (-61 - e) * 0.30102999566398114 + 347;
+ int k = (int)dk;
+ unsigned int index;
+ if(dk - k > 0.0)
+  k++;
+ index = (unsigned int)((k >> 3) + 1);
+ *K = -(-348 + (int)(index << 3));
+ return diyfp_make(mjs__cached_powers_f[index], mjs__cached_powers_e[index]);
+}
+
+
+MJS_INLINE void grisu_round(char *digits, int length, MJS_Uint64 delta, MJS_Uint64 rest, MJS_Uint64 ten_kappa, MJS_Uint64 wp_w) {
+ /* step the last digit down while that gets closer to the value */
+ while(rest < wp_w && delta - rest >= ten_kappa &&
+       (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+  digits[length - 1]--;
+  rest += ten_kappa;
+ }
+}
+
+/*
+ digits of Mp, stop as soon as the rest is inside delta
+*/
+static MJS_HOT int digit_gen(MJSDiyFp W, MJSDiyFp Mp, MJS_Uint64 delta, char *digits, int *K) {
+ const MJSDiyFp one = diyfp_make(1ull << -Mp.e, Mp.e);
+ const MJS_Uint64 wp_w = Mp.f - W.f;
+ unsigned int p1 = (unsigned int)(Mp.f >> -one.e);
+ MJS_Uint64 p2 = Mp.f & (one.f - 1);
+ MJS_Uint64 rest;
+ int kappa;
+ int length = 0;
+ unsigned int d;
+
+ kappa = (int)count_digits32(p1);
+
+ while(kappa > 0) {
+  d = p1 / (unsigned int)mjs__pow10_u64[kappa - 1];
+  p1 %= (unsigned int)mjs__pow10_u64[kappa - 1];
+  if(d || length)
+   digits[length++] = (char)('0' + d);
+  kappa--;
+  rest = ((MJS_Uint64)p1 << -one.e) + p2;
+  if(rest <= delta) {
+   *K += kappa;
+   grisu_round(digits, length, delta, rest, mjs__pow10_u64[kappa] << -one.e, wp_w);
+   return length;
+  }
+ }
+
+ for(;;) {
+  p2 *= 10;
+  delta *= 10;
+  d = (unsigned int)(p2 >> -one.e);
+  if(d || length)
+   digits[length++] = (char)('0' + d);
+  p2 &= one.f - 1;
+  kappa--;
+  if(p2 < delta) {
+   *K += kappa;
+   grisu_round(digits, length, delta, p2, one.f, (-kappa < 20) ? wp_w * mjs__pow10_u64[-kappa] : 0);
+   return length;
+  }
+ }
+}
+
+/*
+ v = f * 2^e, f != 0. the upper boundary is half an ulp above, the lower
+ one a quarter ulp below when v sits on a power of two.
+*/
+static MJS_HOT int grisu2(MJS_Uint64 f, int e, int lower_closer, char *digits, int *K) {
+ const MJSDiyFp plus = diyfp_normalize(diyfp_make((f << 1) + 1, e - 1));
+ MJSDiyFp minus = lower_closer ? diyfp_make((f << 2) - 1, e - 2) : diyfp_make((f << 1) - 1, e - 1);
+ MJSDiyFp c_mk, W, Wp, Wm;
+
+ minus.f <<= minus.e - plus.e;
+ minus.e = plus.e;
+
+ c_mk = cached_power(plus.e, K);
+ W = diyfp_mul(diyfp_normalize(diyfp_make(f, e)), c_mk);
+ Wp = diyfp_mul(plus, c_mk);
+ Wm = diyfp_mul(minus, c_mk);
+ /* stay one unit inside, the products are only rounded */
+ Wm.f++;
+ Wp.f--;
+ return digit_gen(W, Wp, Wp.f - Wm.f, digits, K);
+}
+
+
+MJS_INLINE unsigned int write_exponent(int K, char *out) {
+ unsigned int size = 0;
+ if(K < 0) {
+  out[size++] = '-';
+  K = -K;
+ }
+ if(K >= 100) {
+  out[size++] = (char)('0' + K / 100);
+  K %= 100;
+  out[size++] = (char)('0' + K / 10);
+ } else if(K >= 10) {
+  out[size++] = (char)('0' + K / 10);
+ }
+ out[size++] = (char)('0' + K % 10);
+ return size;
+}
+
+/*
+ digits * 10^k as json, plain decimals for 1e-6 <= v < 1e21,
+ scientific outside of that.
+*/
+static MJS_HOT unsigned int prettify(char *buffer, int length, int k) {
+ const int kk = length + k; /* 10^(kk-1) <= v < 10^kk */
+ int i;
+
+ if(k >= 0 && kk <= 21) {
+  /* 1234e7 -> 12340000000.0 */
+  for(i = length; i < kk; i++)
+   buffer[i] = '0';
+  buffer[kk] = '.';
+  buffer[kk + 1] = '0';
+  return (unsigned int)(kk + 2);
+ } else if(kk > 0 && kk <= 21) {
+  /* 1234e-2 -> 12.34 */
+  memmove(&buffer[kk + 1], &buffer[kk], (size_t)(length - kk));
+  buffer[kk] = '.';
+  return (unsigned int)(length + 1);
+ } else if(kk > -6 && kk <= 0) {
+  /* 1234e-6 -> 0.001234 */
+  const int offset = 2 - kk;
+  memmove(&buffer[offset], &buffer[0], (size_t)length);
+  buffer[0] = '0';
+  buffer[1] = '.';
+  for(i = 2; i < offset; i++)
+   buffer[i] = '0';
+  return (unsigned int)(length + offset);
+ } else if(length == 1) {
+  /* 1e30 */
+  buffer[1] = 'e';
+  return 2 + write_exponent(kk - 1, &buffer[2]);
+ }
+ /* 1234e30 -> 1.234e33 */
+ memmove(&buffer[2], &buffer[1], (size_t)(length - 1));
+ buffer[1] = '.';
+ buffer[length + 1] = 'e';
+ return (unsigned int)(length + 2) + write_exponent(kk - 1, &buffer[length + 2]);
+}
+
+/*
+ shared tail of both widths, f and e as read from the bits
+*/
+MJS_INLINE unsigned int format_binary(MJS_Uint64 f, int e, int lower_closer, int negative, char *out) {
+ unsigned int size = 0;
+ int length, K;
+ if(negative)
+  out[size++] = '-';
+ if(!f) {
+  memcpy(&out[size], "0.0", 3);
+  return size + 3;
+ }
+ length = grisu2(f, e, lower_closer, &out[size], &K);
+ return size + prettify(&out[size], length, K);
+}
+
+/*-----------------Number format func-------------------*/
+
+MJS_HOT unsigned int MJS_FormatDouble(double value, char *out) {
+ MJS_Uint64 bits, significand;
+ unsigned int biased_e;
+ memcpy(&bits, &value, sizeof(double));
+ biased_e = (unsigned int)(bits >> 52) & 0x7FF;
+ significand = bits & 0xFFFFFFFFFFFFFull;
+
+ if(MJS_Unlikely(biased_e == 0x7FF)) {
+  memcpy(out, "null", 4);
+  return 4;
+ }
+ if(biased_e)
+  return format_binary(significand | (1ull << 52), (int)biased_e - 1075, !significand && biased_e > 1, (int)(bits >> 63), out);
+ return format_binary(significand, -1074, 0, (int)(bits >> 63), out);
+}
+
+
+MJS_HOT unsigned int MJS_FormatFloat(float value, char *out) {
+ unsigned int bits, significand, biased_e;
+ memcpy(&bits, &value, sizeof(float));
+ biased_e = (bits >> 23) & 0xFF;
+ significand = bits & 0x7FFFFF;
+
+ if(MJS_Unlikely(biased_e == 0xFF)) {
+  memcpy(out, "null", 4);
+  return 4;
+ }
+ /* float boundaries, so 0.1f is written 0.1 and not 0.10000000149011612 */
+ if(biased_e)
+  return format_binary(significand | (1u << 23), (int)biased_e - 150, !significand && biased_e > 1, (int)(bits >> 31), out);
+ return format_binary(significand, -149, 0, (int)(bits >> 31), out);
+}
+
+
+MJS_HOT unsigned int MJS_FormatInt32(int value, char *out) {
+ if(value < 0) {
+  out[0] = '-';
+  return 1 + format_u32(0u - (unsigned int)value, &out[1]);
+ }
+ return format_u32((unsigned int)value, out);
+}
+
+
+MJS_HOT unsigned int MJS_FormatInt64(MJS_Int64 value, char *out) {
+ if(value < 0) {
+  out[0] = '-';
+  return 1 + format_u64(0ull - (MJS_Uint64)value, &out[1]);
+ }
+ return format_u64((MJS_Uint64)value, out);
+}
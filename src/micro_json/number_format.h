@@ -0,0 +1,21 @@
+#ifndef MC_JSON_NUMBER_FORMAT_H
+#define MC_JSON_NUMBER_FORMAT_H
+
+#include "micro_json/object.h"
+
+/* longest text any of the formatters write */
+#define MJS_NUMBER_TEXT_BYTES 32
+
+/*
+ shortest text that reads back as the same value, integral values
+ keep a ".0" so they stay floating point, nan and inf become null.
+ return the number of bytes written to out, no terminator.
+*/
+MJS_HOT unsigned int MJS_FormatDouble(double value, char *out);
+MJS_HOT unsigned int MJS_FormatFloat(float value, char *out);
+/* decimal integers, same contract */
+MJS_HOT unsigned int MJS_FormatInt32(int value, char *out);
+MJS_HOT unsigned int MJS_FormatInt64(MJS_Int64 value, char *out);
+
+
+#endif
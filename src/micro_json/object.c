@@ -1,6 +1,10 @@
 #include "micro_json/object.h"
 #include "micro_json/object_impl.h"
 
+/* fails to compile when a member change grows the compact value layout */
+typedef char mjs__dynamic_type_size_check[(sizeof(MJSDynamicType) <= 2 * sizeof(double)) ? 1 : -1];
+typedef char mjs__object_pair_size_check[(sizeof(MJSObjectPair) <= 4 * sizeof(double)) ? 1 : -1];
+
 /*-----------------String Pooll::-------------------*/
 
 MJS_COLD int MJSStringPool_Init(MJSStringPool *pool) {
@@ -16,10 +20,19 @@ MJS_COLD int MJSStringPool_Destroy(MJSStringPool *pool) {
  return MJSStringPool_Destroy_IMPL(pool);
 }
 
+/*
+ empty the pool for the next document, chunks and tables are kept.
+*/
+MJS_COLD int MJSStringPool_Reset(MJSStringPool *pool) {
+ if(MJS_Unlikely(!pool))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSStringPool_Reset_IMPL(pool);
+}
+
 
-MJS_HOT unsigned short MJSStringPool_GetCurrentNode(MJSStringPool *pool) {
+MJS_HOT unsigned int MJSStringPool_GetCurrentNode(MJSStringPool *pool) {
  if(MJS_Unlikely(!pool))
-  return 0xFFFF;
+  return 0xFFFFFFFF;
  return MJSStringPool_GetCurrentNode_IMPL(pool);
 }
 
@@ -30,13 +43,27 @@ MJS_HOT int MJSStringPool_ExpandNode(MJSStringPoolNode *node, unsigned int addit
 }
 
 
-MJS_HOT int MJSStringPool_AddToPool(MJSStringPool *pool, const char *str, unsigned int str_size, unsigned int *out_index, unsigned short *out_chunk_index) {
+MJS_HOT int MJSStringPool_AddToPool(MJSStringPool *pool, const char *str, unsigned int str_size, unsigned int *out_index, unsigned int *out_chunk_index) {
  if(MJS_Unlikely(!pool || !str || !out_index || !out_chunk_index))
   return MJS_RESULT_NULL_POINTER;
  return MJSStringPool_AddToPool_IMPL(pool, str, str_size, out_index, out_chunk_index);
 }
 
 
+MJS_COLD int MJSStringPool_SetOptions(MJSStringPool *pool, unsigned char options) {
+ if(MJS_Unlikely(!pool))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSStringPool_SetOptions_IMPL(pool, options);
+}
+
+
+MJS_HOT int MJSStringPool_Intern(MJSStringPool *pool, unsigned int *pool_index, unsigned int str_size, unsigned int *chunk_index) {
+ if(MJS_Unlikely(!pool || !pool_index || !chunk_index))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSStringPool_Intern_IMPL(pool, pool_index, str_size, chunk_index);
+}
+
+
 /*-----------------MJSArray-------------------*/
 /*
  allocate MJSArray object, return 0 if success, return -1 if not.
@@ -44,7 +71,7 @@ MJS_HOT int MJSStringPool_AddToPool(MJSStringPool *pool, const char *str, unsign
 MJS_COLD int MJSArray_Init(MJSArray *arr) {
  if(MJS_Unlikely(!arr))
   return MJS_RESULT_NULL_POINTER;
- return MJSArray_Init_IMPL(arr);
+ return MJSArray_Init_IMPL(arr, NULL);
 }
 
 /*
@@ -62,7 +89,7 @@ MJS_COLD int MJSArray_Destroy(MJSArray *arr) {
 MJS_HOT int MJSArray_Add(MJSArray *arr, MJSDynamicType *value) {
  if(MJS_Unlikely(!arr))
   return MJS_RESULT_NULL_POINTER;
- return MJSArray_Add_IMPL(arr, value);
+ return MJSArray_Add_IMPL(arr, NULL, value);
 }
 
 
@@ -75,6 +102,16 @@ MJS_HOT MJSDynamicType* MJSArray_Get(MJSArray *arr, unsigned int index) {
  return MJSArray_Get_IMPL(arr, index);
 }
 
+/*
+ copy element from MJSArray object, works for packed arrays too.
+*/
+MJS_HOT int MJSArray_GetValue(MJSArray *arr, unsigned int index, MJSDynamicType *out_value) {
+ if(MJS_Unlikely(!arr || !out_value))
+  return MJS_RESULT_NULL_POINTER;
+ MJSArray_GetValue_IMPL(arr, index, out_value);
+ return 0;
+}
+
 /*
  get size from MJSArray object, return size if success, return 0xFFFFFFFF if not.
 */
@@ -84,13 +121,31 @@ MJS_HOT unsigned int MJSArray_Size(MJSArray *arr) {
  return MJSArray_Size_IMPL(arr);
 }
 
+
+MJS_HOT int MJSArray_Pack(MJSArray *arr) {
+ if(MJS_Unlikely(!arr))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSArray_Pack_IMPL(arr);
+}
+
+/*
+ raw element buffer of a packed array, return NULL if the array is not packed.
+*/
+MJS_HOT const void* MJSArray_GetPacked(MJSArray *arr, unsigned char *out_packed_type) {
+ if(MJS_Unlikely(!arr) || !arr->packed_type)
+  return NULL;
+ if(out_packed_type)
+  *out_packed_type = arr->packed_type;
+ return arr->dynamic_type_ptr;
+}
+
 /*-----------------MJSContainer-------------------*/
 
 
 MJS_COLD int MJSObject_Init(MJSObject *container) {
  if(MJS_Unlikely(!container))
   return MJS_RESULT_NULL_POINTER;
- return MJSObject_Init_IMPL(container);
+ return MJSObject_Init_IMPL(container, NULL);
 }
 
 
@@ -102,7 +157,7 @@ MJS_COLD int MJSObject_Destroy(MJSObject *container) {
 
 
 
-MJS_HOT int MJSObject_InsertFromPool(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned short pool_chunk_index, MJSDynamicType *value) {
+MJS_HOT int MJSObject_InsertFromPool(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned int pool_chunk_index, MJSDynamicType *value) {
  if(MJS_Unlikely(!container || !pool))
   return MJS_RESULT_NULL_POINTER;
  return MJSObject_InsertFromPool_IMPL(container, pool, pool_index, str_size, pool_chunk_index, value);
@@ -123,12 +178,82 @@ MJS_HOT MJSDynamicType* MJSObject_Get(MJSObject *container, MJSStringPool *pool,
 }
 
 
-MJS_HOT MJSDynamicType* MJSObject_GetFromPool(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned short pool_chunk_index) {
+MJS_HOT MJSDynamicType* MJSObject_GetFromPool(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned int pool_chunk_index) {
  if(MJS_Unlikely(!container || !pool))
   return NULL;
  return MJSObject_GetFromPool_IMPL(container, pool, pool_index, str_size, pool_chunk_index);
 }
 
+/*
+ get number of pairs from MJSObject, return size if success, return 0xFFFFFFFF if not.
+*/
+MJS_HOT unsigned int MJSObject_Size(MJSObject *container) {
+ if(MJS_Unlikely(!container))
+  return 0xFFFFFFFF;
+ return MJSObject_SlotCount_IMPL(container);
+}
+
+
+MJS_HOT int MJSObject_Iterate(MJSObject *container, MJSStringPool *pool, unsigned int *iter, const char **out_key, unsigned int *out_key_size, MJSDynamicType **out_value) {
+ MJSShapeKey key;
+ if(MJS_Unlikely(!container || !pool || !iter || !out_key || !out_key_size || !out_value))
+  return MJS_RESULT_NULL_POINTER;
+ if(*iter >= MJSObject_SlotCount_IMPL(container))
+  return 0;
+ *out_value = MJSObject_SlotAt_IMPL(container, (*iter)++, &key);
+ *out_key = &pool->root[key.chunk_node_index].str[key.key_pool_index];
+ *out_key_size = key.key_pool_size;
+ return 1;
+}
+
+
+
+/*-----------------MJSKey-------------------*/
+
+MJS_HOT MJSKey MJSKey_Make(const char *key) {
+ if(MJS_Unlikely(!key))
+  return MJSKey_Make_IMPL("", 0);
+ return MJSKey_Make_IMPL(key, (unsigned int)strlen(key));
+}
+
+
+MJS_HOT MJSKey MJSKey_MakeFromSize(const char *key, unsigned int str_size) {
+ if(MJS_Unlikely(!key))
+  return MJSKey_Make_IMPL("", 0);
+ return MJSKey_Make_IMPL(key, str_size);
+}
+
+
+MJS_HOT MJSDynamicType* MJSObject_GetByKey(MJSObject *container, MJSStringPool *pool, const MJSKey *key) {
+ if(MJS_Unlikely(!container || !key || !pool))
+  return NULL;
+ return MJSObject_GetByKey_IMPL(container, pool, key);
+}
+
+
+MJS_HOT unsigned int MJSObject_GetByKeys(MJSObject *container, MJSStringPool *pool, const MJSKey *keys, unsigned int key_count, MJSDynamicType **out_values) {
+ if(MJS_Unlikely(!container || !pool || !keys || !out_values))
+  return 0;
+ return MJSObject_GetByKeys_IMPL(container, pool, keys, key_count, out_values);
+}
+
+
+
+/*-----------------Shapes-------------------*/
+
+MJS_HOT int MJSObject_Share(MJSObject *container, MJSStringPool *pool) {
+ if(MJS_Unlikely(!container || !pool))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSObject_Share_IMPL(container, pool);
+}
+
+
+MJS_HOT MJSShape* MJSObject_GetShape(MJSObject *container) {
+ if(MJS_Unlikely(!container) || !(container->flags & MJS_OBJECT_SHAPED))
+  return NULL;
+ return shaped_object_shape(container);
+}
+
 
 
 /*-----------------MJSParser-------------------*/
@@ -150,6 +275,36 @@ MJS_COLD int MJSParserData_Destroy(MJSParsedData *parsed_data) {
  return MJSParserData_Destroy_IMPL(parsed_data);
 }
 
+/*
+ drop the parsed document, its containers are kept by the pool
+ for the next parse. call it before MJSStringPool_Reset.
+*/
+MJS_COLD int MJSParserData_Reset(MJSParsedData *parsed_data, MJSStringPool *pool) {
+ if(MJS_Unlikely(!parsed_data || !pool))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSParserData_Reset_IMPL(parsed_data, pool);
+}
+
+
+MJS_COLD int MJSParserData_SetOptions(MJSParsedData *parsed_data, unsigned int options) {
+ if(MJS_Unlikely(!parsed_data))
+  return MJS_RESULT_NULL_POINTER;
+ parsed_data->options = options;
+ return 0;
+}
+
+/*
+ set how repeated keys are handled, one of MJS_DUPLICATE_KEY_POLICY.
+*/
+MJS_COLD int MJSParserData_SetDuplicatePolicy(MJSParsedData *parsed_data, unsigned char policy) {
+ if(MJS_Unlikely(!parsed_data))
+  return MJS_RESULT_NULL_POINTER;
+ if(MJS_Unlikely(policy > MJS_DUPLICATE_KEY_NO_CHECK))
+  return MJS_RESULT_INVALID_TYPE;
+ parsed_data->duplicate_policy = policy;
+ return 0;
+}
+
 
 /*-----------------MJSOutputStreamBuffer_Init-------------------*/
 MJS_COLD int MJSOutputStreamBuffer_Init(MJSOutputStreamBuffer *buff, unsigned char mode, FILE* fp) {
@@ -159,6 +314,34 @@ MJS_COLD int MJSOutputStreamBuffer_Init(MJSOutputStreamBuffer *buff, unsigned ch
 }
 
 
+MJS_COLD int MJSOutputStreamBuffer_InitFd(MJSOutputStreamBuffer *buff, int fd) {
+ if(MJS_Unlikely(!buff))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSOutputStreamBuffer_InitFd_IMPL(buff, fd);
+}
+
+
+MJS_COLD int MJSOutputStreamBuffer_InitFdGather(MJSOutputStreamBuffer *buff, int fd) {
+ if(MJS_Unlikely(!buff))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSOutputStreamBuffer_InitFdGather_IMPL(buff, fd);
+}
+
+
+MJS_COLD int MJSOutputStreamBuffer_InitFdAsync(MJSOutputStreamBuffer *buff, int fd) {
+ if(MJS_Unlikely(!buff))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSOutputStreamBuffer_InitFdAsync_IMPL(buff, fd);
+}
+
+
+MJS_COLD int MJSOutputStreamBuffer_InitFixed(MJSOutputStreamBuffer *buff, char *arr, unsigned int arr_size) {
+ if(MJS_Unlikely(!buff || !arr))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSOutputStreamBuffer_InitFixed_IMPL(buff, arr, arr_size);
+}
+
+
 MJS_COLD int MJSOutputStreamBuffer_Destroy(MJSOutputStreamBuffer *buff) {
  if(MJS_Unlikely(!buff))
   return MJS_RESULT_NULL_POINTER;
@@ -166,6 +349,22 @@ MJS_COLD int MJSOutputStreamBuffer_Destroy(MJSOutputStreamBuffer *buff) {
 }
 
 
+MJS_COLD int MJSOutputStreamBuffer_Reset(MJSOutputStreamBuffer *buff) {
+ if(MJS_Unlikely(!buff))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSOutputStreamBuffer_Reset_IMPL(buff);
+}
+
+
+MJS_COLD int MJSOutputStreamBuffer_Reserve(MJSOutputStreamBuffer *buff, unsigned int size) {
+ if(MJS_Unlikely(!buff))
+  return MJS_RESULT_NULL_POINTER;
+ if(buff->mode != MJS_WRITE_TO_MEMORY_BUFFER)
+  return 0;
+ return MJSOutputStreamBuffer_Reserve_IMPL(buff, size);
+}
+
+
 MJS_HOT int MJSOutputStreamBuffer_Write(MJSOutputStreamBuffer *buff, char *arr, unsigned int arr_size) {
  if(MJS_Unlikely(!buff))
   return MJS_RESULT_NULL_POINTER;
@@ -173,6 +372,13 @@ MJS_HOT int MJSOutputStreamBuffer_Write(MJSOutputStreamBuffer *buff, char *arr,
 }
 
 
+MJS_HOT int MJSOutputStreamBuffer_WriteRef(MJSOutputStreamBuffer *buff, const char *arr, unsigned int arr_size) {
+ if(MJS_Unlikely(!buff || !arr))
+  return MJS_RESULT_NULL_POINTER;
+ return MJSOutputStreamBuffer_WriteRef_IMPL(buff, arr, arr_size);
+}
+
+
 MJS_HOT int MJSOutputStreamBuffer_Flush(MJSOutputStreamBuffer *buff) {
  if(MJS_Unlikely(!buff))
   return MJS_RESULT_NULL_POINTER;
@@ -6,6 +6,24 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#define MJS_POSIX_IO
+#if defined(IOV_MAX) && IOV_MAX < MJS_MAX_GATHER_IOV
+#define MJS_GATHER_IOV IOV_MAX
+#else
+#define MJS_GATHER_IOV MJS_MAX_GATHER_IOV
+#endif
+#endif
+
+#if defined(MJS_ENABLE_ASYNC_WRITER) && defined(MJS_POSIX_IO)
+#include <pthread.h>
+#define MJS_ASYNC_IO
+#endif
+
 /*-----------------Static func-------------------*/
 
 #define IS_POWER_OF_TWO(x)  (!((x) & ((x) - 1)))
@@ -52,23 +70,15 @@ MJS_INLINE void __aligned_dealloc(void* ptr) {
 
 /*-----------------Static func-------------------*/
 /*
- Hash Function
- TODO : optimize this, mininize loop branches
- or use agressive unrolling
+ Hash Function, FNV-1a over the whole key so keys sharing
+ a prefix do not pile up in the open addressing tables.
 */
-MJS_INLINE unsigned int generate_hash_index(const char *str, unsigned int str_size) {
- unsigned int index = 0;
- unsigned int i = 0;
- const unsigned int m = str_size < 4 ? str_size : 4;
- 
- while(i < m) index += (unsigned int)str[i++];
-
- /* power of two makes it a lot faster than other values */
-#if IS_POWER_OF_TWO(MJS_MAX_HASH_BUCKETS)
- return (index * 123) & (MJS_MAX_HASH_BUCKETS-1);
-#else
- return (index * 123) % MJS_MAX_HASH_BUCKETS;
-#endif
+MJS_INLINE unsigned int generate_hash(const char *str, unsigned int str_size) {
+ unsigned int hash = 2166136261u;
+ unsigned int i;
+ for(i = 0; i < str_size; i++)
+  hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+ return hash;
 }
 
 
@@ -78,90 +88,387 @@ static MJS_COLD int MJSStringPool_Init_IMPL(MJSStringPool *pool) {
  pool->root = (MJSStringPoolNode*)__aligned_alloc(sizeof(MJSStringPoolNode) * MJS_MAX_POOL_CHUNK_NODE);
  pool->node_size = 1;
  pool->node_reserve = MJS_MAX_POOL_CHUNK_NODE-1;
+ pool->intern_table = NULL;
+ pool->intern_size = 0;
+ pool->intern_capacity = 0;
+ pool->shape_table = NULL;
+ pool->shape_size = 0;
+ pool->shape_capacity = 0;
+ pool->block_cache = NULL;
+ pool->node_allocated = 1;
+ pool->options = 0;
  if(MJS_Unlikely(!pool->root))
   return MJS_RESULT_ALLOCATION_FAILED;
  pool->root[0].str = (char*)__aligned_alloc(MJS_MAX_POOL_ALLOCATION_BYTES);
  pool->root[0].pool_size = 0;
  pool->root[0].pool_reserve = MJS_MAX_POOL_ALLOCATION_BYTES;
- return 0;
+ return !pool->root[0].str * MJS_RESULT_ALLOCATION_FAILED;
 }
 
 
 static MJS_COLD int MJSStringPool_Destroy_IMPL(MJSStringPool *pool) {
  unsigned int i;
- for(i = 0; i < pool->node_size; i++) {
+ void *block, *next;
+ for(i = 0; i < pool->node_allocated; i++) {
   __aligned_dealloc(pool->root[i].str);
  }
  __aligned_dealloc(pool->root);
+ if(pool->block_cache) {
+  for(i = 0; i < MJS_MAX_BLOCK_CACHE_SIZES; i++) {
+   for(block = pool->block_cache[i].head; block; block = next) {
+    memcpy(&next, block, sizeof(void*));
+    __aligned_dealloc(block);
+   }
+  }
+  __aligned_dealloc(pool->block_cache);
+ }
+ if(pool->intern_table)
+  __aligned_dealloc(pool->intern_table);
+ if(pool->shape_table) {
+  MJSShape *shape, *next;
+  for(i = 0; i < pool->shape_capacity; i++) {
+   for(shape = pool->shape_table[i]; shape; shape = next) {
+    next = shape->next;
+    __aligned_dealloc(shape);
+   }
+  }
+  __aligned_dealloc(pool->shape_table);
+ }
  return 0;
 }
 
 
-static MJS_HOT unsigned short MJSStringPool_GetCurrentNode_IMPL(MJSStringPool *pool) {
- unsigned short i;
- MJSStringPoolNode *curr = NULL;
- i = pool->node_size - 1;
- curr = &pool->root[i];
- 
- if(curr->pool_size < MJS_MAX_POOL_MEMORY_THRESHOLD)
+/*
+ index of the chunk new strings go to. a chunk is retired once less than
+ MJS_MAX_POOL_MEMORY_THRESHOLD bytes are left, the next one is twice as
+ large up to MJS_MAX_POOL_CHUNK_BYTES, so big documents need few chunks.
+*/
+static MJS_HOT unsigned int MJSStringPool_GetCurrentNode_IMPL(MJSStringPool *pool) {
+ unsigned int i = pool->node_size - 1;
+ MJSStringPoolNode *curr = &pool->root[i];
+ MJSStringPoolNode *root;
+ unsigned int chunk_bytes = curr->pool_size + curr->pool_reserve;
+
+ if(MJS_Likely(curr->pool_reserve >= MJS_MAX_POOL_MEMORY_THRESHOLD))
   return i;
- 
+
+ /* chunks kept by a reset come back in the same order */
+ if(pool->node_size < pool->node_allocated) {
+  pool->node_reserve--;
+  return pool->node_size++;
+ }
+
+ chunk_bytes = (chunk_bytes >= (MJS_MAX_POOL_CHUNK_BYTES >> 1)) ? MJS_MAX_POOL_CHUNK_BYTES : (chunk_bytes << 1);
+ if(chunk_bytes < MJS_MAX_POOL_ALLOCATION_BYTES)
+  chunk_bytes = MJS_MAX_POOL_ALLOCATION_BYTES;
+
+ /* the node array doubles too */
  if(MJS_Unlikely(!pool->node_reserve)) {
-  pool->root = (MJSStringPoolNode*)__aligned_realloc(pool->root, sizeof(MJSStringPoolNode) * (pool->node_size + MJS_MAX_POOL_CHUNK_NODE));
-  if(MJS_Unlikely(!pool->root))
-   return 0xFFFF;
-  pool->node_reserve = MJS_MAX_POOL_CHUNK_NODE;
- }
- i = pool->node_size++;
- curr = &pool->root[i];
- curr->str = (char*)__aligned_alloc(MJS_MAX_POOL_ALLOCATION_BYTES);
+  root = (MJSStringPoolNode*)__aligned_realloc(pool->root, sizeof(MJSStringPoolNode) * (pool->node_size << 1));
+  if(MJS_Unlikely(!root))
+   return 0xFFFFFFFF;
+  pool->root = root;
+  pool->node_reserve = pool->node_size;
+ }
+ curr = &pool->root[pool->node_size];
+ curr->str = (char*)__aligned_alloc(chunk_bytes);
  if(MJS_Unlikely(!curr->str))
-  return 0xFFFF;
-  
+  return 0xFFFFFFFF;
+
  curr->pool_size = 0;
- curr->pool_reserve = MJS_MAX_POOL_ALLOCATION_BYTES;
- 
+ curr->pool_reserve = chunk_bytes;
  pool->node_reserve--;
- return i;
+ pool->node_allocated++;
+ return pool->node_size++;
 }
 
-
+/*
+ make room for at least additional_size more bytes, the chunk at least
+ doubles so a long string only costs a logarithmic number of copies.
+*/
 static MJS_HOT int MJSStringPool_ExpandNode_IMPL(MJSStringPoolNode *node, unsigned int additional_size) {
- node->str = (char*)__aligned_realloc(node->str, node->pool_size + node->pool_reserve + additional_size);
+ const unsigned int capacity = node->pool_size + node->pool_reserve;
+ char *str;
+ if(additional_size < capacity)
+  additional_size = capacity;
+ str = (char*)__aligned_realloc(node->str, capacity + additional_size);
+ if(MJS_Unlikely(!str))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ node->str = str;
  node->pool_reserve += additional_size;
- return !node->str * MJS_RESULT_ALLOCATION_FAILED;
+ return 0;
 }
 
 
-static MJS_HOT int MJSStringPool_AddToPool_IMPL(MJSStringPool *pool, const char *str, unsigned int str_size, unsigned int *out_index, unsigned short *out_chunk_index) {
+static MJS_HOT int MJSStringPool_AddToPool_IMPL(MJSStringPool *pool, const char *str, unsigned int str_size, unsigned int *out_index, unsigned int *out_chunk_index) {
  int result = 0;
  *out_chunk_index = MJSStringPool_GetCurrentNode_IMPL(pool);
+ if(MJS_Unlikely(*out_chunk_index == 0xFFFFFFFF))
+  return MJS_RESULT_ALLOCATION_FAILED;
  MJSStringPoolNode *node = &pool->root[*out_chunk_index];
 
  *out_index = node->pool_size;
  if(MJS_Unlikely(node->pool_reserve <= str_size))
   result = MJSStringPool_ExpandNode_IMPL(node, str_size - node->pool_reserve + 1);
+ if(MJS_Unlikely(result))
+  return result;
 
  memcpy(&node->str[node->pool_size], str, str_size);
  node->pool_size += str_size;
  node->str[node->pool_size++] = '\0';
+ node->pool_reserve -= str_size + 1;
+ return result;
+}
+
+/*-----------------String Interning-------------------*/
+/*
+ double the open addressing table and rehash the canonical entries
+*/
+static MJS_COLD int MJSStringPool_GrowIntern_IMPL(MJSStringPool *pool) {
+ const unsigned int capacity = pool->intern_capacity ? (pool->intern_capacity << 1) : MJS_MAX_INTERN_ELEMENTS;
+ MJSInternEntry *table = (MJSInternEntry*)__aligned_alloc(sizeof(MJSInternEntry) * capacity);
+ unsigned int i, slot;
+ if(MJS_Unlikely(!table))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ memset(table, 0, sizeof(MJSInternEntry) * capacity);
+
+ for(i = 0; i < pool->intern_capacity; i++) {
+  if(!pool->intern_table[i].str_size)
+   continue;
+  slot = pool->intern_table[i].hash & (capacity-1);
+  while(table[slot].str_size)
+   slot = (slot+1) & (capacity-1);
+  table[slot] = pool->intern_table[i];
+ }
+
+ if(pool->intern_table)
+  __aligned_dealloc(pool->intern_table);
+ pool->intern_table = table;
+ pool->intern_capacity = capacity;
+ return 0;
+}
+
+
+/*
+ double the shape registry buckets and relink the shapes
+*/
+static MJS_COLD int MJSStringPool_GrowShapes_IMPL(MJSStringPool *pool) {
+ const unsigned int capacity = pool->shape_capacity ? (pool->shape_capacity << 1) : MJS_MAX_SHAPE_BUCKETS;
+ MJSShape **table = (MJSShape**)__aligned_alloc(sizeof(MJSShape*) * capacity);
+ MJSShape *shape, *next;
+ unsigned int i;
+ if(MJS_Unlikely(!table))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ memset(table, 0, sizeof(MJSShape*) * capacity);
+
+ for(i = 0; i < pool->shape_capacity; i++) {
+  for(shape = pool->shape_table[i]; shape; shape = next) {
+   next = shape->next;
+   shape->next = table[shape->hash & (capacity-1)];
+   table[shape->hash & (capacity-1)] = shape;
+  }
+ }
+
+ if(pool->shape_table)
+  __aligned_dealloc(pool->shape_table);
+ pool->shape_table = table;
+ pool->shape_capacity = capacity;
+ return 0;
+}
+
+
+static MJS_COLD int MJSStringPool_SetOptions_IMPL(MJSStringPool *pool, unsigned char options) {
+ int result = 0;
+ pool->options = options;
+ if((options & (MJS_POOL_INTERN_KEYS | MJS_POOL_INTERN_STRINGS)) && !pool->intern_table)
+  result = MJSStringPool_GrowIntern_IMPL(pool);
+ if(!result && (options & MJS_POOL_SHARE_SHAPES) && !pool->shape_table)
+  result = MJSStringPool_GrowShapes_IMPL(pool);
  return result;
 }
 
+/*-----------------Block cache-------------------*/
+/*
+ bucket for blocks of exactly bytes, NULL when it is missing and
+ create is 0, or when every bucket holds another size.
+*/
+MJS_INLINE MJSBlockCache* pool_block_bucket(MJSStringPool *pool, unsigned int bytes, int create) {
+ const unsigned int mask = MJS_MAX_BLOCK_CACHE_SIZES - 1;
+ unsigned int slot = (bytes * 2654435761u) >> 16;
+ unsigned int i;
+ MJSBlockCache *bucket;
+ for(i = 0; i <= mask; i++) {
+  bucket = &pool->block_cache[(slot + i) & mask];
+  if(bucket->bytes == bytes)
+   return bucket;
+  if(!bucket->bytes) {
+   if(!create)
+    return NULL;
+   bucket->bytes = bytes;
+   return bucket;
+  }
+ }
+ return NULL;
+}
+
+/*
+ container buffers, taken from the block cache when a reset left one
+ of the same size. pool may be NULL.
+*/
+MJS_INLINE void* pool_block_alloc(MJSStringPool *pool, unsigned int bytes) {
+ MJSBlockCache *bucket;
+ void *block;
+ if(pool && pool->block_cache && (bucket = pool_block_bucket(pool, bytes, 0)) && bucket->head) {
+  block = bucket->head;
+  memcpy(&bucket->head, block, sizeof(void*));
+  return block;
+ }
+ return __aligned_alloc(bytes);
+}
+
+
+MJS_INLINE void pool_block_free(MJSStringPool *pool, void *block, unsigned int bytes) {
+ MJSBlockCache *bucket = NULL;
+ if(pool && pool->block_cache && bytes >= sizeof(void*))
+  bucket = pool_block_bucket(pool, bytes, 1);
+ if(!bucket) {
+  __aligned_dealloc(block);
+  return;
+ }
+ memcpy(block, &bucket->head, sizeof(void*));
+ bucket->head = block;
+}
+
+
+/*
+ with a cache the old block is kept too, containers grow by doubling so
+ the next document finds every intermediate size.
+*/
+MJS_INLINE void* pool_block_realloc(MJSStringPool *pool, void *block, unsigned int old_bytes, unsigned int bytes) {
+ void *out;
+ if(!pool || !pool->block_cache)
+  return __aligned_realloc(block, bytes);
+ out = pool_block_alloc(pool, bytes);
+ if(MJS_Unlikely(!out))
+  return NULL;
+ memcpy(out, block, (old_bytes < bytes) ? old_bytes : bytes);
+ pool_block_free(pool, block, old_bytes);
+ return out;
+}
+
+/*
+ rewind every chunk and forget interned strings and shapes, the memory
+ is kept for the next document. parsed data using the pool must be
+ reset or destroyed first.
+*/
+static MJS_COLD int MJSStringPool_Reset_IMPL(MJSStringPool *pool) {
+ unsigned int i;
+ MJSShape *shape, *next;
+ MJSStringPoolNode *node;
+
+ for(i = 0; i < pool->node_allocated; i++) {
+  node = &pool->root[i];
+  node->pool_reserve += node->pool_size;
+  node->pool_size = 0;
+ }
+ pool->node_reserve += pool->node_size - 1;
+ pool->node_size = 1;
+
+ if(pool->intern_table)
+  memset(pool->intern_table, 0, sizeof(MJSInternEntry) * pool->intern_capacity);
+ pool->intern_size = 0;
+
+ if(pool->shape_table) {
+  for(i = 0; i < pool->shape_capacity; i++) {
+   for(shape = pool->shape_table[i]; shape; shape = next) {
+    next = shape->next;
+    pool_block_free(pool, shape, (unsigned int)(sizeof(MJSShape) + sizeof(MJSShapeKey) * shape->key_count + sizeof(unsigned short) * (shape->index_mask + 1)));
+   }
+  }
+  memset(pool->shape_table, 0, sizeof(MJSShape*) * pool->shape_capacity);
+ }
+ pool->shape_size = 0;
+ return 0;
+}
+
+
+/*
+ replace a freshly pooled string with its canonical copy,
+ the fresh copy is given back to the chunk when it is still the tail.
+*/
+static MJS_HOT int MJSStringPool_Intern_IMPL(MJSStringPool *pool, unsigned int *pool_index, unsigned int str_size, unsigned int *chunk_index) {
+ if(MJS_Unlikely(!str_size || !pool->intern_capacity))
+  return 0;
+
+ MJSStringPoolNode *node = &pool->root[*chunk_index];
+ const char *str = &node->str[*pool_index];
+ const unsigned int hash = generate_hash(str, str_size);
+ const unsigned int mask = pool->intern_capacity - 1;
+ unsigned int slot = hash & mask;
+ MJSInternEntry *entry;
+
+ while(pool->intern_table[slot].str_size) {
+  entry = &pool->intern_table[slot];
+  if(entry->hash == hash && entry->str_size == str_size) {
+   if(entry->pool_index == *pool_index && entry->chunk_index == *chunk_index)
+    return 0; /* already canonical */
+   if(!memcmp(&pool->root[entry->chunk_index].str[entry->pool_index], str, str_size)) {
+    if((*pool_index + str_size + 1) == node->pool_size) {
+     node->pool_size -= str_size + 1;
+     node->pool_reserve += str_size + 1;
+    }
+    *pool_index = entry->pool_index;
+    *chunk_index = entry->chunk_index;
+    return 0;
+   }
+  }
+  slot = (slot+1) & mask;
+ }
+
+ entry = &pool->intern_table[slot];
+ entry->hash = hash;
+ entry->pool_index = *pool_index;
+ entry->str_size = str_size;
+ entry->chunk_index = *chunk_index;
+
+ /* keep the load factor under one half */
+ if(MJS_Unlikely((++pool->intern_size << 1) >= pool->intern_capacity))
+  return MJSStringPool_GrowIntern_IMPL(pool);
+ return 0;
+}
+
 /*-----------------MJSArray-------------------*/
 /*
- allocate MJSArray object, return 0 if success, return -1 if not.
+ unpacked arrays have room for 1 << reserve elements, the smallest
+ shift holding count elements.
+*/
+MJS_INLINE unsigned char array_capacity_shift(unsigned int count) {
+ unsigned char shift = 0;
+ while((1u << shift) < count)
+  shift++;
+ return shift;
+}
+
+/*
+ allocate MJSArray object with room for count elements,
+ return 0 if success, return -1 if not.
 */
-static MJS_HOT int MJSArray_Init_IMPL(MJSArray *arr) { 
+static MJS_HOT int MJSArray_InitReserve_IMPL(MJSArray *arr, MJSStringPool *pool, unsigned int count) { 
  int result = 0;
  arr->type = MJS_TYPE_ARRAY;
- arr->dynamic_type_ptr = (MJSDynamicType*)__aligned_alloc(sizeof(MJSDynamicType) * MJS_MAX_RESERVE_ELEMENTS);
+ arr->reserve = array_capacity_shift((count > MJS_MAX_RESERVE_ELEMENTS) ? count : MJS_MAX_RESERVE_ELEMENTS);
+ arr->dynamic_type_ptr = (MJSDynamicType*)pool_block_alloc(pool, (unsigned int)sizeof(MJSDynamicType) << arr->reserve);
  result = !arr->dynamic_type_ptr * MJS_RESULT_ALLOCATION_FAILED;
- arr->reserve = MJS_MAX_RESERVE_ELEMENTS;
+ arr->packed_type = MJS_PACKED_NONE;
  arr->size = 0;
  return result;
 }
 
+
+static MJS_HOT int MJSArray_Init_IMPL(MJSArray *arr, MJSStringPool *pool) { 
+ return MJSArray_InitReserve_IMPL(arr, pool, MJS_MAX_RESERVE_ELEMENTS);
+}
+
 /*
  destroy MJSArray object, return 0 if success, return -1 if not.
 */
@@ -171,6 +478,10 @@ static MJS_COLD int MJSArray_Destroy_IMPL(MJSArray *arr) {
  */
  int result;
  unsigned int i;
+ if(arr->packed_type) {
+  __aligned_dealloc(arr->dynamic_type_ptr);
+  return 0;
+ }
  for(i = 0; i < arr->size; i++) {
   switch(arr->dynamic_type_ptr[i].type) {
    case MJS_TYPE_ARRAY:
@@ -199,23 +510,131 @@ static MJS_COLD int MJSArray_Destroy_IMPL(MJSArray *arr) {
 }
 
 /*
- add to MJSArray object, return 0 if success, return -1 if not.
+ read one element of any array layout into out_value
+*/
+MJS_INLINE void MJSArray_GetValue_IMPL(MJSArray *arr, unsigned int index, MJSDynamicType *out_value) {
+ switch(arr->packed_type) {
+  case MJS_PACKED_INT64:
+   out_value->type = MJS_TYPE_NUMBER_INT;
+   out_value->value_int.value = (int)((const MJS_Int64*)arr->dynamic_type_ptr)[index];
+  break;
+  case MJS_PACKED_FLOAT:
+   out_value->type = MJS_TYPE_NUMBER_FLOAT;
+   out_value->value_float.value = ((const float*)arr->dynamic_type_ptr)[index];
+  break;
+  case MJS_PACKED_DOUBLE:
+   out_value->type = MJS_TYPE_NUMBER_DOUBLE;
+   out_value->value_double.value = ((const double*)arr->dynamic_type_ptr)[index];
+  break;
+  case MJS_PACKED_BOOLEAN:
+   out_value->type = MJS_TYPE_BOOLEAN;
+   out_value->value_boolean.value = ((const unsigned char*)arr->dynamic_type_ptr)[index];
+  break;
+  default:
+   *out_value = arr->dynamic_type_ptr[index];
+  break;
+ }
+}
+
+/*
+ store an array whose elements all share one number/boolean type as a raw
+ element buffer, mixed arrays are left untouched so values keep their type.
 */
-MJS_HOT static int MJSArray_Add_IMPL(MJSArray *arr, MJSDynamicType *value) {
- if(MJS_Likely(arr->reserve > 0)) {
-  arr->dynamic_type_ptr[arr->size++] = *value;
-  arr->reserve--;
+static MJS_HOT int MJSArray_Pack_IMPL(MJSArray *arr) {
+ MJSDynamicType *values = arr->dynamic_type_ptr;
+ unsigned char *out = (unsigned char*)values;
+ unsigned int seen = 0;
+ unsigned int i, element_size;
+ unsigned char packed_type;
+ MJS_Int64 int_value;
+
+ if(arr->packed_type || !arr->size)
+  return 0;
+
+ for(i = 0; i < arr->size; i++)
+  seen |= 1u << values[i].type;
+
+ if(seen == (1u << MJS_TYPE_NUMBER_INT)) {
+  packed_type = MJS_PACKED_INT64;
+  element_size = sizeof(MJS_Int64);
+ } else if(seen == (1u << MJS_TYPE_NUMBER_FLOAT)) {
+  packed_type = MJS_PACKED_FLOAT;
+  element_size = sizeof(float);
+ } else if(seen == (1u << MJS_TYPE_NUMBER_DOUBLE)) {
+  packed_type = MJS_PACKED_DOUBLE;
+  element_size = sizeof(double);
+ } else if(seen == (1u << MJS_TYPE_BOOLEAN)) {
+  packed_type = MJS_PACKED_BOOLEAN;
+  element_size = sizeof(unsigned char);
  } else {
+  return 0;
+ }
+
+ /*
+  in place, element i is read before its slot is reused,
+  stores go through memcpy so they are never reordered before the reads.
+ */
+ for(i = 0; i < arr->size; i++) {
+  switch(packed_type) {
+   case MJS_PACKED_INT64:
+    int_value = values[i].value_int.value;
+    memcpy(&out[i * sizeof(MJS_Int64)], &int_value, sizeof(MJS_Int64));
+   break;
+   case MJS_PACKED_FLOAT:
+    memcpy(&out[i * sizeof(float)], &values[i].value_float.value, sizeof(float));
+   break;
+   case MJS_PACKED_DOUBLE:
+    memcpy(&out[i * sizeof(double)], &values[i].value_double.value, sizeof(double));
+   break;
+   default:
+    out[i] = values[i].value_boolean.value;
+   break;
+  }
+ }
+
+ values = (MJSDynamicType*)__aligned_realloc(values, element_size * arr->size);
+ if(MJS_Unlikely(!values))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ arr->dynamic_type_ptr = values;
+ arr->packed_type = packed_type;
+ arr->reserve = 0;
+ return 0;
+}
+
+/*
+ back to one MJSDynamicType per element, before a packed array is modified
+*/
+static MJS_COLD int MJSArray_Unpack_IMPL(MJSArray *arr, MJSStringPool *pool) {
+ const unsigned char shift = array_capacity_shift(arr->size + MJS_MAX_RESERVE_ELEMENTS);
+ MJSDynamicType *values = (MJSDynamicType*)pool_block_alloc(pool, (unsigned int)sizeof(MJSDynamicType) << shift);
+ unsigned int i;
+ if(MJS_Unlikely(!values))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ for(i = 0; i < arr->size; i++)
+  MJSArray_GetValue_IMPL(arr, i, &values[i]);
+ __aligned_dealloc(arr->dynamic_type_ptr);
+ arr->dynamic_type_ptr = values;
+ arr->packed_type = MJS_PACKED_NONE;
+ arr->reserve = shift;
+ return 0;
+}
 
-  arr->dynamic_type_ptr = (MJSDynamicType*)__aligned_realloc(arr->dynamic_type_ptr, sizeof(MJSDynamicType) * (arr->size + MJS_MAX_RESERVE_ELEMENTS));
-  if(MJS_Unlikely(!arr->dynamic_type_ptr))
+/*
+ add to MJSArray object, return 0 if success, return -1 if not.
+*/
+MJS_HOT static int MJSArray_Add_IMPL(MJSArray *arr, MJSStringPool *pool, MJSDynamicType *value) {
+ MJSDynamicType *values;
+ if(MJS_Unlikely(arr->packed_type) && MJSArray_Unpack_IMPL(arr, pool))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ if(MJS_Unlikely(arr->size == (1u << arr->reserve))) {
+  /* double, so adding stays amortized O(1) */
+  values = (MJSDynamicType*)pool_block_realloc(pool, arr->dynamic_type_ptr, (unsigned int)sizeof(MJSDynamicType) << arr->reserve, (unsigned int)sizeof(MJSDynamicType) << (arr->reserve + 1));
+  if(MJS_Unlikely(!values))
    return MJS_RESULT_ALLOCATION_FAILED;
-   
-  arr->reserve = MJS_MAX_RESERVE_ELEMENTS-1;
-  
-  /* add value */
-  arr->dynamic_type_ptr[arr->size++] = *value;
+  arr->dynamic_type_ptr = values;
+  arr->reserve++;
  }
+ arr->dynamic_type_ptr[arr->size++] = *value;
  return 0;
 }
 
@@ -224,6 +643,8 @@ MJS_HOT static int MJSArray_Add_IMPL(MJSArray *arr, MJSDynamicType *value) {
  get element ptr from MJSArray object, return ptr if success, return NULL if not.
 */
 MJS_INLINE MJSDynamicType* MJSArray_Get_IMPL(MJSArray *arr, unsigned int index) {
+ if(MJS_Unlikely(arr->packed_type))
+  return NULL;
  return &arr->dynamic_type_ptr[index];
 }
 
@@ -236,223 +657,722 @@ MJS_INLINE unsigned int MJSArray_Size_IMPL(MJSArray *arr) {
 
 
 /*-----------------MJSContainer-------------------*/
+/*
+ small objects keep their pairs densely packed, followed by
+ one 16 bit tag (key length, first byte) per pair for a SWAR scan.
+*/
+#define MJS_SMALL_OBJECT_TAG_WORDS ((MJS_MAX_SMALL_OBJECT_PAIRS + 3) >> 2)
+#define MJS_SMALL_OBJECT_BYTES (sizeof(MJSObjectPair) * MJS_MAX_SMALL_OBJECT_PAIRS + sizeof(MJS_Uint64) * MJS_SMALL_OBJECT_TAG_WORDS)
 
-static MJS_HOT int MJSObject_Init_IMPL(MJSObject *container) {
- int result = 0;
- const unsigned int pre_allocated_pair = sizeof(MJSObjectPair) * (MJS_MAX_HASH_BUCKETS + MJS_MAX_RESERVE_ELEMENTS);
- container->obj_pair_ptr = (MJSObjectPair*)__aligned_alloc(pre_allocated_pair);
- result = !container->obj_pair_ptr * MJS_RESULT_ALLOCATION_FAILED;
- if(MJS_Likely(!result))
- memset(container->obj_pair_ptr, 0xFF, pre_allocated_pair);
- container->type = MJS_TYPE_OBJECT;
- container->reserve = MJS_MAX_RESERVE_ELEMENTS;
- container->obj_pair_size = 0;
- return result;
+MJS_INLINE unsigned short* small_object_tags(MJSObject *container) {
+ return (unsigned short*)&container->obj_pair_ptr[MJS_MAX_SMALL_OBJECT_PAIRS];
 }
 
 
-static MJS_COLD int MJSObject_Destroy_IMPL(MJSObject *container) {
- /* destroy other allocated memory first. */
- int result;
- unsigned int i;
- unsigned int estimated_size = container->obj_pair_size + container->reserve + MJS_MAX_HASH_BUCKETS;
- for(i = 0; i < estimated_size; i++) {
-  switch(container->obj_pair_ptr[i].value.type) {
-   case MJS_TYPE_ARRAY:
-    result = MJSArray_Destroy(&container->obj_pair_ptr[i].value.value_array);
-    if(MJS_Unlikely(result)) return result;
-   break;
-   case MJS_TYPE_OBJECT:
-    result = MJSObject_Destroy(&container->obj_pair_ptr[i].value.value_object);
-    if(MJS_Unlikely(result)) return result;
-   break;
-   case MJS_TYPE_STRING:
-   case MJS_TYPE_BOOLEAN:
-   case MJS_TYPE_NULL:
-   case MJS_TYPE_NUMBER_INT:
-   case MJS_TYPE_NUMBER_FLOAT:
-   case MJS_TYPE_NUMBER_DOUBLE:
-   case 0xFF:
-   break;
-   default:
-    return MJS_RESULT_INVALID_TYPE;
-   break;
-  }
- }
- __aligned_dealloc(container->obj_pair_ptr);
- return 0;
+MJS_INLINE unsigned short small_object_tag(const char *key, unsigned int str_size) {
+ return (unsigned short)(((str_size & 0xFF) << 8) | (unsigned char)key[0]);
 }
 
+/*
+ hashed objects keep their pairs dense in insertion order, room for
+ 1 << reserve of them, followed by an open addressing index of twice
+ as many slots holding pair position + 1 (0 is empty).
+*/
+#define MJS_HASHED_OBJECT_MIN_SHIFT 4
+
+MJS_INLINE unsigned int* hashed_object_index(MJSObject *container) {
+ return (unsigned int*)&container->obj_pair_ptr[1u << container->reserve];
+}
 
 
-MJS_HOT static int MJSObject_InsertFromPool_IMPL(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned short pool_chunk_index, MJSDynamicType *value) {
- if(MJS_Unlikely(!str_size))
-  return MJS_RESULT_EMPTY_KEY;
-  
- const char *key = &pool->root[pool_chunk_index].str[pool_index];
- const unsigned int str_pool_index = pool_index;
- MJSObjectPair pair;
- 
- pair.key_pool_index = str_pool_index;
- pair.key_pool_size = str_size;
- pair.chunk_node_index = pool_chunk_index;
- pair.next = 0xFFFFFFFF;
- pair.value = *value;
+MJS_INLINE unsigned int hashed_object_bytes(unsigned int shift) {
+ return (unsigned int)(sizeof(MJSObjectPair) + sizeof(unsigned int) * 2) << shift;
+}
 
-	const unsigned int hash_index = generate_hash_index(key, str_size);
-	if(container->reserve == 0) {
-	 unsigned int max_size = container->reserve + container->obj_pair_size + MJS_MAX_HASH_BUCKETS;
 
-  container->obj_pair_ptr = (MJSObjectPair*)__aligned_realloc(container->obj_pair_ptr, (max_size + MJS_MAX_RESERVE_ELEMENTS) * sizeof(MJSObjectPair));
-  if(MJS_Unlikely(!container->obj_pair_ptr))
-   return MJS_RESULT_ALLOCATION_FAILED;
+MJS_INLINE unsigned int hashed_object_slot(unsigned int hash, unsigned int shift) {
+ /* fibonacci hashing, the top bits pick one of the 2 << shift slots */
+ return (hash * 2654435761u) >> (31 - shift);
+}
 
-		memset(&container->obj_pair_ptr[max_size], 0xFF, MJS_MAX_RESERVE_ELEMENTS * sizeof(MJSObjectPair));
-	 container->reserve = MJS_MAX_RESERVE_ELEMENTS;
-	}
- 
-	MJSObjectPair *start_node = &container->obj_pair_ptr[hash_index];
+/*
+ rebuild the index from the cached pair hashes
+*/
+MJS_INLINE void hashed_object_reindex(MJSObject *container) {
+ const unsigned int shift = container->reserve;
+ const unsigned int mask = (2u << shift) - 1;
+ unsigned int *index = hashed_object_index(container);
+ unsigned int i, slot;
+ memset(index, 0, sizeof(unsigned int) << (shift + 1));
+ for(i = 0; i < container->obj_pair_size; i++) {
+  slot = hashed_object_slot(container->obj_pair_ptr[i].hash, shift);
+  while(index[slot])
+   slot = (slot + 1) & mask;
+  index[slot] = i + 1;
+ }
+}
 
- if(str_size == start_node->key_pool_size) {
-  if(!memcmp(key, &pool->root[start_node->chunk_node_index].str[start_node->key_pool_index], str_size)) {
-   return MJS_RESULT_DUPLICATE_KEY;
+/*
+ probe the index, candidates are confirmed with the pool slot
+ (interned keys) or memcmp, return the pair position or 0xFFFFFFFF.
+*/
+MJS_INLINE unsigned int hashed_object_find(MJSObject *container, MJSStringPool *pool, const char *key, unsigned int str_size, unsigned int hash, unsigned int pool_index, unsigned int pool_chunk_index, int interned) {
+ const unsigned int shift = container->reserve;
+ const unsigned int mask = (2u << shift) - 1;
+ const unsigned int *index = hashed_object_index(container);
+ unsigned int slot = hashed_object_slot(hash, shift);
+ unsigned int i;
+ MJSObjectPair *pair;
+ while((i = index[slot])) {
+  pair = &container->obj_pair_ptr[i-1];
+  if(pair->hash == hash && pair->key_pool_size == str_size) {
+   if((pair->key_pool_index == pool_index && pair->chunk_node_index == pool_chunk_index) || (!interned && !memcmp(key, &pool->root[pair->chunk_node_index].str[pair->key_pool_index], str_size)))
+    return i-1;
   }
+  slot = (slot + 1) & mask;
  }
- 
-	if(start_node->key_pool_index == 0xFFFFFFFF) {
-		*start_node = pair;
-	} else {
-
-	 unsigned int prev_index = hash_index;
-  unsigned int next_index = start_node->next;
- 	while(next_index != 0xFFFFFFFF) {
- 	 start_node = &container->obj_pair_ptr[next_index];
- 		prev_index = next_index;
-
- 	 if(str_size == start_node->key_pool_size) {
-    if(!memcmp(key, &pool->root[start_node->chunk_node_index].str[start_node->key_pool_index], str_size)) {
-     return MJS_RESULT_DUPLICATE_KEY;
-    }
- 	 }
-
-		 next_index = start_node->next;
- 	}
-
-		next_index = MJS_MAX_HASH_BUCKETS + container->obj_pair_size;
-		container->obj_pair_ptr[next_index] = pair;
-		container->obj_pair_ptr[prev_index].next = next_index;
+ return 0xFFFFFFFF;
+}
 
-		container->reserve--;
-		container->obj_pair_size++;
+/*
+ append a pair known to be new, doubles the pairs and the index when full
+*/
+static MJS_HOT int hashed_object_append(MJSObject *container, MJSStringPool *pool, const MJSObjectPair *pair) {
+ unsigned int *index;
+ unsigned int slot, mask;
+ MJSObjectPair *pairs;
+ if(MJS_Unlikely(container->obj_pair_size == (1u << container->reserve))) {
+  pairs = (MJSObjectPair*)pool_block_realloc(pool, container->obj_pair_ptr, hashed_object_bytes(container->reserve), hashed_object_bytes(container->reserve + 1));
+  if(MJS_Unlikely(!pairs))
+   return MJS_RESULT_ALLOCATION_FAILED;
+  container->obj_pair_ptr = pairs;
+  container->reserve++;
+  hashed_object_reindex(container);
  }
+ index = hashed_object_index(container);
+ mask = (2u << container->reserve) - 1;
+ slot = hashed_object_slot(pair->hash, container->reserve);
+ while(index[slot])
+  slot = (slot + 1) & mask;
+ container->obj_pair_ptr[container->obj_pair_size] = *pair;
+ index[slot] = ++container->obj_pair_size;
  return 0;
 }
 
+/*
+ number of pairs, every layout is dense and in insertion order
+*/
+MJS_INLINE unsigned int MJSObject_SlotCount_IMPL(MJSObject *container) {
+ return container->obj_pair_size;
+}
+
+/*
+ shaped objects keep the shape pointer in the first value slot,
+ followed by one value per shape key.
+*/
+MJS_INLINE MJSShape* shaped_object_shape(MJSObject *container) {
+ return *(MJSShape**)container->obj_pair_ptr;
+}
 
-MJS_INLINE int MJSObject_Insert_IMPL(MJSObject *container, MJSStringPool *pool, const char *key, unsigned int str_size, MJSDynamicType *value) { 
- if(MJS_Unlikely(!key[0])) /* empty key */
-  return MJS_RESULT_EMPTY_KEY;
- int result = 0;
- MJSObjectPair pair;
- 
- pair.key_pool_size = str_size;
- pair.next = 0xFFFFFFFF;
- pair.value = *value;
 
-	const unsigned int hash_index = generate_hash_index(key, str_size);
-	
-	if(container->reserve == 0) {
-	 unsigned int max_size = container->reserve + container->obj_pair_size + MJS_MAX_HASH_BUCKETS;
+MJS_INLINE MJSDynamicType* shaped_object_values(MJSObject *container) {
+ return ((MJSDynamicType*)container->obj_pair_ptr) + 1;
+}
 
-  container->obj_pair_ptr = (MJSObjectPair*)__aligned_realloc(container->obj_pair_ptr, (max_size + MJS_MAX_RESERVE_ELEMENTS) * sizeof(MJSObjectPair));
-  if(MJS_Unlikely(!container->obj_pair_ptr))
-   return MJS_RESULT_ALLOCATION_FAILED;
-		memset(&container->obj_pair_ptr[max_size], 0xFF, MJS_MAX_RESERVE_ELEMENTS * sizeof(MJSObjectPair));
-	 container->reserve = MJS_MAX_RESERVE_ELEMENTS;
-	}
- 
-	MJSObjectPair *start_node = &container->obj_pair_ptr[hash_index];
+/*
+ size the pair buffer was allocated with, for the block cache
+*/
+MJS_INLINE unsigned int object_block_bytes(MJSObject *container) {
+ if(container->flags & MJS_OBJECT_SHAPED)
+  return (unsigned int)sizeof(MJSDynamicType) * (container->obj_pair_size + 1);
+ if(container->flags & MJS_OBJECT_SMALL)
+  return MJS_SMALL_OBJECT_BYTES;
+ if(container->flags & MJS_OBJECT_UNINDEXED)
+  return (unsigned int)sizeof(MJSObjectPair) << container->reserve;
+ return hashed_object_bytes(container->reserve);
+}
 
- if(str_size == start_node->key_pool_size) {
-  if(!memcmp(key, &pool->root[start_node->chunk_node_index].str[start_node->key_pool_index], str_size)) {
-   return MJS_RESULT_DUPLICATE_KEY;
-  }
+/*
+ value and key of the i-th pair
+*/
+MJS_INLINE MJSDynamicType* MJSObject_SlotAt_IMPL(MJSObject *container, unsigned int i, MJSShapeKey *key) {
+ MJSObjectPair *pair;
+ if(container->flags & MJS_OBJECT_SHAPED) {
+  *key = shaped_object_shape(container)->keys[i];
+  return &shaped_object_values(container)[i];
  }
+ pair = &container->obj_pair_ptr[i];
+ key->key_pool_index = pair->key_pool_index;
+ key->key_pool_size = pair->key_pool_size;
+ key->chunk_node_index = pair->chunk_node_index;
+ return &pair->value;
+}
 
-	if(start_node->key_pool_index == 0xFFFFFFFF) { 
-		result = MJSStringPool_AddToPool_IMPL(pool, key, str_size, &pair.key_pool_index, &pair.chunk_node_index);
-		*start_node = pair;
-	} else {
-	 unsigned int prev_index = hash_index;
-  unsigned int next_index = start_node->next;
- 	while(next_index != 0xFFFFFFFF) {
- 	 start_node = &container->obj_pair_ptr[next_index];
- 		prev_index = next_index;
+/*
+ compare 4 tags per 64 bit word, candidates are confirmed with the
+ pool slot (interned keys) or memcmp, return the pair index or 0xFFFFFFFF.
+*/
+MJS_INLINE unsigned int small_object_find(MJSObject *container, MJSStringPool *pool, const char *key, unsigned int str_size, unsigned int pool_index, unsigned int pool_chunk_index, int interned) {
+ const unsigned short *tags = small_object_tags(container);
+ const MJS_Uint64 ones = 0x0001000100010001ULL;
+ const MJS_Uint64 highs = 0x8000800080008000ULL;
+ const MJS_Uint64 pattern = ones * small_object_tag(key, str_size);
+ const unsigned int size = container->obj_pair_size;
+ MJSObjectPair *pair;
+ MJS_Uint64 word, bits;
+ unsigned int w, lane;
+
+ for(w = 0; (w << 2) < size; w++) {
+  const unsigned short *t = &tags[w << 2];
+  word = ((MJS_Uint64)t[0]) | ((MJS_Uint64)t[1] << 16) | ((MJS_Uint64)t[2] << 32) | ((MJS_Uint64)t[3] << 48);
+  word ^= pattern;
+
+  /* high bit set on zero lanes (matching tags) */
+  bits = (word - ones) & ~word & highs;
+  if((size - (w << 2)) < 4)
+   bits &= highs >> ((4 - (size - (w << 2))) << 4);
+
+  while(bits) {
+   lane = (w << 2) + (MJS_CountTrailingZeroes64(bits) >> 4);
+   pair = &container->obj_pair_ptr[lane];
+   if(pair->key_pool_size == str_size) {
+    if((pair->key_pool_index == pool_index && pair->chunk_node_index == pool_chunk_index) || (!interned && !memcmp(key, &pool->root[pair->chunk_node_index].str[pair->key_pool_index], str_size)))
+     return lane;
+   }
+   bits &= bits - 1;
+  }
+ }
+ return 0xFFFFFFFF;
+}
 
- 	 if(str_size == start_node->key_pool_size) {
-    if(!memcmp(key, &pool->root[start_node->chunk_node_index].str[start_node->key_pool_index], str_size)) {
-     return MJS_RESULT_DUPLICATE_KEY; 
-    }
- 	 }
 
-		 next_index = start_node->next;
- 	}
- 	
-		result = MJSStringPool_AddToPool_IMPL(pool, key, str_size, &pair.key_pool_index, &pair.chunk_node_index);
+MJS_INLINE void small_object_append(MJSObject *container, MJSObjectPair *pair, const char *key) {
+ small_object_tags(container)[container->obj_pair_size] = small_object_tag(key, pair->key_pool_size);
+ container->obj_pair_ptr[container->obj_pair_size++] = *pair;
+ container->reserve--;
+}
 
-		next_index = MJS_MAX_HASH_BUCKETS + container->obj_pair_size;
-		
-		container->obj_pair_ptr[next_index] = pair;
-		container->obj_pair_ptr[prev_index].next = next_index;
 
-		container->reserve--;
-		container->obj_pair_size++;
- }
-	
+/*-----------------Shapes-------------------*/
+/*
+ open addressing probe over the shape keys, return the value index or 0xFFFFFFFF
+*/
+MJS_INLINE unsigned int shape_find(MJSShape *shape, MJSStringPool *pool, const char *key, unsigned int str_size, unsigned int hash) {
+ unsigned int slot = hash & shape->index_mask;
+ unsigned int i;
+ MJSShapeKey *k;
+ while((i = shape->index[slot])) {
+  k = &shape->keys[i-1];
+  if(k->key_pool_size == str_size && !memcmp(key, &pool->root[k->chunk_node_index].str[k->key_pool_index], str_size))
+   return i-1;
+  slot = (slot+1) & shape->index_mask;
+ }
+ return 0xFFFFFFFF;
+}
+
+/*
+ interned keys hash by pool slot, the others by content
+*/
+MJS_INLINE unsigned int shape_key_hash(MJSStringPool *pool, const MJSShapeKey *key, int interned) {
+ if(interned)
+  return (key->key_pool_index * 2654435761u) ^ key->chunk_node_index;
+ return generate_hash(&pool->root[key->chunk_node_index].str[key->key_pool_index], key->key_pool_size);
+}
+
+
+static MJS_HOT int shape_matches(MJSShape *shape, MJSObject *container, MJSStringPool *pool, int interned) {
+ const unsigned int slot_count = MJSObject_SlotCount_IMPL(container);
+ unsigned int i;
+ MJSShapeKey key;
+ MJSShapeKey *shape_key;
+ for(i = 0; i < slot_count; i++) {
+  MJSObject_SlotAt_IMPL(container, i, &key);
+  shape_key = &shape->keys[i];
+  if(key.key_pool_size != shape_key->key_pool_size)
+   return 0;
+  if(key.key_pool_index == shape_key->key_pool_index && key.chunk_node_index == shape_key->chunk_node_index)
+   continue;
+  if(interned || memcmp(&pool->root[key.chunk_node_index].str[key.key_pool_index], &pool->root[shape_key->chunk_node_index].str[shape_key->key_pool_index], key.key_pool_size))
+   return 0;
+ }
+ return 1;
+}
+
+/*
+ one allocation, header then keys then the index
+*/
+static MJS_COLD MJSShape* MJSShape_Create_IMPL(MJSObject *container, MJSStringPool *pool, unsigned int key_count, unsigned int hash) {
+ unsigned int index_size = 4;
+ unsigned int i, slot;
+ MJSShape *shape;
+ MJSShapeKey key;
+
+ while(index_size < (key_count << 1))
+  index_size <<= 1;
+
+ shape = (MJSShape*)pool_block_alloc(pool, (unsigned int)(sizeof(MJSShape) + sizeof(MJSShapeKey) * key_count + sizeof(unsigned short) * index_size));
+ if(MJS_Unlikely(!shape))
+  return NULL;
+ shape->next = NULL;
+ shape->keys = (MJSShapeKey*)(shape + 1);
+ shape->index = (unsigned short*)(shape->keys + key_count);
+ shape->hash = hash;
+ shape->key_count = key_count;
+ shape->index_mask = index_size - 1;
+ memset(shape->index, 0, sizeof(unsigned short) * index_size);
+
+ for(i = 0; i < key_count; i++) {
+  MJSObject_SlotAt_IMPL(container, i, &key);
+  shape->keys[i] = key;
+  slot = generate_hash(&pool->root[key.chunk_node_index].str[key.key_pool_index], key.key_pool_size) & shape->index_mask;
+  while(shape->index[slot])
+   slot = (slot+1) & shape->index_mask;
+  shape->index[slot] = (unsigned short)(i + 1);
+ }
+ return shape;
+}
+
+/*
+ move the values of an object into a dense array behind a shared shape,
+ does nothing when the pool is not sharing shapes.
+*/
+static MJS_HOT int MJSObject_Share_IMPL(MJSObject *container, MJSStringPool *pool) {
+ const int interned = pool->options & MJS_POOL_INTERN_KEYS;
+ const unsigned int count = MJSObject_SlotCount_IMPL(container);
+ unsigned int i;
+ unsigned int hash = 2166136261u;
+ MJSShape *shape;
+ MJSShapeKey key;
+ MJSDynamicType *values;
+
+ if(!pool->shape_table || (container->flags & MJS_OBJECT_SHAPED))
+  return 0;
+
+ for(i = 0; i < count; i++) {
+  MJSObject_SlotAt_IMPL(container, i, &key);
+  hash = (hash ^ shape_key_hash(pool, &key, interned)) * 16777619u;
+ }
+ if(!count || count > 0xFFFE)
+  return 0;
+
+ for(shape = pool->shape_table[hash & (pool->shape_capacity-1)]; shape; shape = shape->next) {
+  if(shape->hash == hash && shape->key_count == count && shape_matches(shape, container, pool, interned))
+   break;
+ }
+
+ if(!shape) {
+  shape = MJSShape_Create_IMPL(container, pool, count, hash);
+  if(MJS_Unlikely(!shape))
+   return MJS_RESULT_ALLOCATION_FAILED;
+  shape->next = pool->shape_table[hash & (pool->shape_capacity-1)];
+  pool->shape_table[hash & (pool->shape_capacity-1)] = shape;
+  if(MJS_Unlikely(++pool->shape_size > pool->shape_capacity) && MJSStringPool_GrowShapes_IMPL(pool))
+   return MJS_RESULT_ALLOCATION_FAILED;
+ }
+
+ values = (MJSDynamicType*)pool_block_alloc(pool, sizeof(MJSDynamicType) * (count + 1));
+ if(MJS_Unlikely(!values))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ *(MJSShape**)values = shape;
+ for(i = 0; i < count; i++)
+  values[i + 1] = *MJSObject_SlotAt_IMPL(container, i, &key);
+
+ pool_block_free(pool, container->obj_pair_ptr, object_block_bytes(container));
+ container->obj_pair_ptr = (MJSObjectPair*)values;
+ container->obj_pair_size = count;
+ container->reserve = 0;
+ container->flags = MJS_OBJECT_SHAPED;
  return 0;
 }
 
 
-MJS_INLINE MJSDynamicType* MJSObject_Get_IMPL(MJSObject *container, MJSStringPool *pool, const char *key, unsigned int str_size) {  
- const unsigned int key_len = str_size;
- const unsigned int hash_index = generate_hash_index(key, key_len);
+static MJS_HOT int MJSObject_Init_IMPL(MJSObject *container, MJSStringPool *pool) {
+ int result = 0;
+ container->obj_pair_ptr = (MJSObjectPair*)pool_block_alloc(pool, MJS_SMALL_OBJECT_BYTES);
+ result = !container->obj_pair_ptr * MJS_RESULT_ALLOCATION_FAILED;
+ if(MJS_Likely(!result))
+ memset(small_object_tags(container), 0, sizeof(MJS_Uint64) * MJS_SMALL_OBJECT_TAG_WORDS);
+ container->type = MJS_TYPE_OBJECT;
+ container->reserve = MJS_MAX_SMALL_OBJECT_PAIRS;
+ container->obj_pair_size = 0;
+ container->flags = MJS_OBJECT_SMALL;
+ return result;
+}
+
+/*
+ move a full small object into the hashed layout, a deferred object
+ only gets room for its pairs, the index comes on the first lookup.
+*/
+static MJS_HOT int MJSObject_Promote_IMPL(MJSObject *container, MJSStringPool *pool, int deferred) {
+ MJSObjectPair *small_pairs = container->obj_pair_ptr;
+ const unsigned int count = container->obj_pair_size;
+ unsigned int shift = MJS_HASHED_OBJECT_MIN_SHIFT;
+ MJSObjectPair *pairs;
+ unsigned int i;
 
-	MJSObjectPair *start_node = NULL;
+ while((1u << shift) <= count)
+  shift++;
+ pairs = (MJSObjectPair*)pool_block_alloc(pool, deferred ? (unsigned int)sizeof(MJSObjectPair) << shift : hashed_object_bytes(shift));
+ if(MJS_Unlikely(!pairs))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ memcpy(pairs, small_pairs, sizeof(MJSObjectPair) * count);
+ pool_block_free(pool, small_pairs, MJS_SMALL_OBJECT_BYTES);
+
+ container->obj_pair_ptr = pairs;
+ container->reserve = (unsigned char)shift;
+ container->flags &= ~MJS_OBJECT_SMALL;
+ if(deferred) {
+  container->flags |= MJS_OBJECT_UNINDEXED;
+  return 0;
+ }
 
-  unsigned int next_index = hash_index;
-  do {
-	 	start_node = &container->obj_pair_ptr[next_index];
- 	 if(key_len == start_node->key_pool_size) {
-    if(!memcmp(key, &pool->root[start_node->chunk_node_index].str[start_node->key_pool_index], key_len)) {
-	 	  return &start_node->value;
-	 	 }
- 	 }
-		 next_index = start_node->next;
- 	} while(next_index != 0xFFFFFFFF);
- return NULL;
+ /* keys are already unique, only hash and index them */
+ for(i = 0; i < count; i++)
+  pairs[i].hash = generate_hash(&pool->root[pairs[i].chunk_node_index].str[pairs[i].key_pool_index], pairs[i].key_pool_size);
+ hashed_object_reindex(container);
+ return 0;
+}
+
+/*
+ an empty object with room for count pairs, objects too large for the
+ small layout start hashed (or unindexed when deferred).
+*/
+static MJS_HOT int MJSObject_InitReserve_IMPL(MJSObject *container, MJSStringPool *pool, unsigned int count, int deferred) {
+ unsigned int shift = MJS_HASHED_OBJECT_MIN_SHIFT;
+ if(count <= MJS_MAX_SMALL_OBJECT_PAIRS)
+  return MJSObject_Init_IMPL(container, pool);
+
+ while((1u << shift) < count)
+  shift++;
+ container->obj_pair_ptr = (MJSObjectPair*)pool_block_alloc(pool, deferred ? (unsigned int)sizeof(MJSObjectPair) << shift : hashed_object_bytes(shift));
+ if(MJS_Unlikely(!container->obj_pair_ptr))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ container->type = MJS_TYPE_OBJECT;
+ container->reserve = (unsigned char)shift;
+ container->obj_pair_size = 0;
+ container->flags = deferred ? MJS_OBJECT_UNINDEXED : 0;
+ if(!deferred)
+  hashed_object_reindex(container);
+ return 0;
+}
+
+/*
+ hash the pairs of a deferred object and build its index. only
+ MJS_DUPLICATE_KEY_NO_CHECK parses defer, repeated keys are kept and
+ the first pair is found by lookups, as in an indexed NO_CHECK object.
+*/
+static MJS_COLD int MJSObject_BuildIndex_IMPL(MJSObject *container, MJSStringPool *pool) {
+ MJSObjectPair *pairs = (MJSObjectPair*)pool_block_realloc(pool, container->obj_pair_ptr, (unsigned int)sizeof(MJSObjectPair) << container->reserve, hashed_object_bytes(container->reserve));
+ unsigned int i;
+ if(MJS_Unlikely(!pairs))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ for(i = 0; i < container->obj_pair_size; i++)
+  pairs[i].hash = generate_hash(&pool->root[pairs[i].chunk_node_index].str[pairs[i].key_pool_index], pairs[i].key_pool_size);
+ container->obj_pair_ptr = pairs;
+ container->flags &= ~MJS_OBJECT_UNINDEXED;
+ hashed_object_reindex(container);
+ return 0;
+}
+
+static MJS_COLD int MJSObject_Destroy_IMPL(MJSObject *container) {
+ /* destroy other allocated memory first. */
+ int result;
+ unsigned int i;
+ unsigned int estimated_size = MJSObject_SlotCount_IMPL(container);
+ MJSDynamicType *value;
+ MJSShapeKey key;
+ for(i = 0; i < estimated_size; i++) {
+  value = MJSObject_SlotAt_IMPL(container, i, &key);
+  switch(value->type) {
+   case MJS_TYPE_ARRAY:
+    result = MJSArray_Destroy(&value->value_array);
+    if(MJS_Unlikely(result)) return result;
+   break;
+   case MJS_TYPE_OBJECT:
+    result = MJSObject_Destroy(&value->value_object);
+    if(MJS_Unlikely(result)) return result;
+   break;
+   case MJS_TYPE_STRING:
+   case MJS_TYPE_BOOLEAN:
+   case MJS_TYPE_NULL:
+   case MJS_TYPE_NUMBER_INT:
+   case MJS_TYPE_NUMBER_FLOAT:
+   case MJS_TYPE_NUMBER_DOUBLE:
+   break;
+   default:
+    return MJS_RESULT_INVALID_TYPE;
+   break;
+  }
+ }
+ __aligned_dealloc(container->obj_pair_ptr);
+ return 0;
+}
+
+
+
+static MJS_HOT int MJSObject_Unshare_IMPL(MJSObject *container, MJSStringPool *pool);
+
+/*
+ free what a value owns, for values that never made it into a container
+*/
+MJS_INLINE void destroy_value(MJSDynamicType *value) {
+ if(value->type == MJS_TYPE_ARRAY)
+  MJSArray_Destroy(&value->value_array);
+ else if(value->type == MJS_TYPE_OBJECT)
+  MJSObject_Destroy(&value->value_object);
 }
 
+/*
+ add a pair whose key is already in the pool, a repeated key is handled
+ by policy (MJS_DUPLICATE_KEY_POLICY). deferred large objects only store
+ the pair, callers defer only under MJS_DUPLICATE_KEY_NO_CHECK.
+*/
+MJS_HOT static int MJSObject_Append_IMPL(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned int pool_chunk_index, MJSDynamicType *value, unsigned char policy, int deferred) {
+ int result;
+ if(MJS_Unlikely(!str_size))
+  return MJS_RESULT_EMPTY_KEY;
+ if(MJS_Unlikely(container->flags & MJS_OBJECT_SHAPED) && (result = MJSObject_Unshare_IMPL(container, pool)))
+  return result;
+ if(MJS_Unlikely(container->flags & MJS_OBJECT_UNINDEXED) && !deferred && MJSObject_BuildIndex_IMPL(container, pool))
+  return MJS_RESULT_ALLOCATION_FAILED;
 
-MJS_INLINE MJSDynamicType* MJSObject_GetFromPool_IMPL(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned short pool_chunk_index) {
  const char *key = &pool->root[pool_chunk_index].str[pool_index];
- const unsigned int key_len = str_size;
- const unsigned int hash_index = generate_hash_index(key, key_len);
- 
-	MJSObjectPair *start_node = NULL;
+ /* interned keys are only equal when they share the same pool slot */
+ const int interned = pool->options & MJS_POOL_INTERN_KEYS;
+ const int check = policy != MJS_DUPLICATE_KEY_NO_CHECK;
+ unsigned int i = 0xFFFFFFFF;
+ MJSObjectPair *pairs;
+ MJSObjectPair pair;
 
-  unsigned int next_index = hash_index;
- 	do {
-	 	start_node = &container->obj_pair_ptr[next_index];
+ pair.key_pool_index = pool_index;
+ pair.key_pool_size = str_size;
+ pair.chunk_node_index = pool_chunk_index;
+ pair.hash = 0xFFFFFFFF;
+ pair.value = *value;
 
- 	 if(key_len == start_node->key_pool_size) {
-    if(!memcmp(key, &pool->root[start_node->chunk_node_index].str[start_node->key_pool_index], key_len)) {
-	 	  return &start_node->value;
-	 	 }
- 	 }
-		 next_index = start_node->next;
- 	} while(next_index != 0xFFFFFFFF);
+ if(container->flags & MJS_OBJECT_SMALL) {
+  if(check)
+   i = small_object_find(container, pool, key, str_size, pool_index, pool_chunk_index, interned);
+  if(i == 0xFFFFFFFF) {
+   if(MJS_Likely(container->reserve)) {
+    small_object_append(container, &pair, key);
+    return 0;
+   }
+   if(MJS_Unlikely(MJSObject_Promote_IMPL(container, pool, deferred)))
+    return MJS_RESULT_ALLOCATION_FAILED;
+  }
+ }
 
- return NULL;
+ if(i == 0xFFFFFFFF) {
+  if(container->flags & MJS_OBJECT_UNINDEXED) {
+   if(MJS_Unlikely(container->obj_pair_size == (1u << container->reserve))) {
+    pairs = (MJSObjectPair*)pool_block_realloc(pool, container->obj_pair_ptr, (unsigned int)sizeof(MJSObjectPair) << container->reserve, (unsigned int)sizeof(MJSObjectPair) << (container->reserve + 1));
+    if(MJS_Unlikely(!pairs))
+     return MJS_RESULT_ALLOCATION_FAILED;
+    container->obj_pair_ptr = pairs;
+    container->reserve++;
+   }
+   container->obj_pair_ptr[container->obj_pair_size++] = pair;
+   return 0;
+  }
+  pair.hash = generate_hash(key, str_size);
+  if(check)
+   i = hashed_object_find(container, pool, key, str_size, pair.hash, pool_index, pool_chunk_index, interned);
+  if(i == 0xFFFFFFFF)
+   return hashed_object_append(container, pool, &pair);
+ }
+
+ /* repeated key, the pair keeps its first position */
+ switch(policy) {
+  case MJS_DUPLICATE_KEY_LAST_WINS:
+   destroy_value(&container->obj_pair_ptr[i].value);
+   container->obj_pair_ptr[i].value = *value;
+   return 0;
+  case MJS_DUPLICATE_KEY_FIRST_WINS:
+   destroy_value(value);
+   return 0;
+ }
+ return MJS_RESULT_DUPLICATE_KEY;
+}
+
+
+MJS_HOT static int MJSObject_InsertFromPool_IMPL(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned int pool_chunk_index, MJSDynamicType *value) {
+ return MJSObject_Append_IMPL(container, pool, pool_index, str_size, pool_chunk_index, value, MJS_DUPLICATE_KEY_ERROR, 0);
+}
+
+
+/*
+ give a shaped object its own pairs back before it diverges from the shape.
+ the keys were accepted when the shape was made, a NO_CHECK parse may
+ have repeated them, so they are copied without a duplicate check.
+*/
+static MJS_HOT int MJSObject_Unshare_IMPL(MJSObject *container, MJSStringPool *pool) {
+ MJSShape *shape = shaped_object_shape(container);
+ MJSDynamicType *values = shaped_object_values(container);
+ MJSObject tmp;
+ unsigned int i;
+ int result = MJSObject_Init_IMPL(&tmp, pool);
+
+ for(i = 0; i < shape->key_count && !result; i++)
+  result = MJSObject_Append_IMPL(&tmp, pool, shape->keys[i].key_pool_index, shape->keys[i].key_pool_size, shape->keys[i].chunk_node_index, &values[i], MJS_DUPLICATE_KEY_NO_CHECK, 0);
+
+ if(MJS_Unlikely(result)) {
+  /* the values still belong to the shaped object */
+  if(tmp.obj_pair_ptr)
+   pool_block_free(pool, tmp.obj_pair_ptr, object_block_bytes(&tmp));
+  return result;
+ }
+ pool_block_free(pool, container->obj_pair_ptr, object_block_bytes(container));
+ *container = tmp;
+ return 0;
+}
+
+
+MJS_INLINE int MJSObject_Insert_IMPL(MJSObject *container, MJSStringPool *pool, const char *key, unsigned int str_size, MJSDynamicType *value) {
+ if(MJS_Unlikely(!key[0])) /* empty key */
+  return MJS_RESULT_EMPTY_KEY;
+ int result = 0;
+ if(MJS_Unlikely(container->flags & MJS_OBJECT_SHAPED) && (result = MJSObject_Unshare_IMPL(container, pool)))
+  return result;
+ MJSObjectPair pair;
+
+ pair.key_pool_size = str_size;
+ pair.hash = 0xFFFFFFFF;
+ pair.value = *value;
+
+ if(container->flags & MJS_OBJECT_SMALL) {
+  if(small_object_find(container, pool, key, str_size, 0xFFFFFFFF, 0xFFFFFFFF, 0) != 0xFFFFFFFF)
+   return MJS_RESULT_DUPLICATE_KEY;
+  if(MJS_Likely(container->reserve)) {
+   result = MJSStringPool_AddToPool_IMPL(pool, key, str_size, &pair.key_pool_index, &pair.chunk_node_index);
+   if(MJS_Likely(!result) && (pool->options & MJS_POOL_INTERN_KEYS))
+    result = MJSStringPool_Intern_IMPL(pool, &pair.key_pool_index, str_size, &pair.chunk_node_index);
+   if(MJS_Likely(!result))
+    small_object_append(container, &pair, key);
+   return result;
+  }
+  result = MJSObject_Promote_IMPL(container, pool, 0);
+  if(MJS_Unlikely(result))
+   return result;
+ }
+ if(MJS_Unlikely(container->flags & MJS_OBJECT_UNINDEXED) && MJSObject_BuildIndex_IMPL(container, pool))
+  return MJS_RESULT_ALLOCATION_FAILED;
+
+ pair.hash = generate_hash(key, str_size);
+ if(hashed_object_find(container, pool, key, str_size, pair.hash, 0xFFFFFFFF, 0xFFFFFFFF, 0) != 0xFFFFFFFF)
+  return MJS_RESULT_DUPLICATE_KEY;
+
+ result = MJSStringPool_AddToPool_IMPL(pool, key, str_size, &pair.key_pool_index, &pair.chunk_node_index);
+ if(MJS_Likely(!result) && (pool->options & MJS_POOL_INTERN_KEYS))
+  result = MJSStringPool_Intern_IMPL(pool, &pair.key_pool_index, str_size, &pair.chunk_node_index);
+ if(MJS_Unlikely(result))
+  return result;
+ return hashed_object_append(container, pool, &pair);
+}
+
+
+MJS_INLINE MJSDynamicType* MJSObject_Get_IMPL(MJSObject *container, MJSStringPool *pool, const char *key, unsigned int str_size) {
+ unsigned int i;
+ if(container->flags & MJS_OBJECT_SHAPED) {
+  i = shape_find(shaped_object_shape(container), pool, key, str_size, generate_hash(key, str_size));
+  return (i != 0xFFFFFFFF) ? &shaped_object_values(container)[i] : NULL;
+ }
+ if(MJS_Unlikely(container->flags & MJS_OBJECT_UNINDEXED) && MJSObject_BuildIndex_IMPL(container, pool))
+  return NULL;
+ if(container->flags & MJS_OBJECT_SMALL)
+  i = small_object_find(container, pool, key, str_size, 0xFFFFFFFF, 0xFFFFFFFF, 0);
+ else
+  i = hashed_object_find(container, pool, key, str_size, generate_hash(key, str_size), 0xFFFFFFFF, 0xFFFFFFFF, 0);
+ return (i != 0xFFFFFFFF) ? &container->obj_pair_ptr[i].value : NULL;
+}
+
+
+MJS_INLINE MJSDynamicType* MJSObject_GetFromPool_IMPL(MJSObject *container, MJSStringPool *pool, unsigned int pool_index, unsigned int str_size, unsigned int pool_chunk_index) {
+ const char *key = &pool->root[pool_chunk_index].str[pool_index];
+ unsigned int i;
+ if(container->flags & MJS_OBJECT_SHAPED) {
+  i = shape_find(shaped_object_shape(container), pool, key, str_size, generate_hash(key, str_size));
+  return (i != 0xFFFFFFFF) ? &shaped_object_values(container)[i] : NULL;
+ }
+ if(MJS_Unlikely(container->flags & MJS_OBJECT_UNINDEXED) && MJSObject_BuildIndex_IMPL(container, pool))
+  return NULL;
+ if(container->flags & MJS_OBJECT_SMALL)
+  i = small_object_find(container, pool, key, str_size, pool_index, pool_chunk_index, 0);
+ else
+  i = hashed_object_find(container, pool, key, str_size, generate_hash(key, str_size), pool_index, pool_chunk_index, 0);
+ return (i != 0xFFFFFFFF) ? &container->obj_pair_ptr[i].value : NULL;
+}
+
+
+/*-----------------MJSKey-------------------*/
+/*
+ precompute the hash of a key, so repeated lookups
+ only pay for the index probe.
+*/
+MJS_INLINE MJSKey MJSKey_Make_IMPL(const char *key, unsigned int str_size) {
+ MJSKey out;
+ out.str = key;
+ out.str_size = str_size;
+ out.hash = generate_hash(key, str_size);
+ return out;
+}
+
+
+MJS_INLINE MJSDynamicType* MJSObject_GetByKey_IMPL(MJSObject *container, MJSStringPool *pool, const MJSKey *key) {
+ unsigned int i;
+ if(container->flags & MJS_OBJECT_SHAPED) {
+  i = shape_find(shaped_object_shape(container), pool, key->str, key->str_size, key->hash);
+  return (i != 0xFFFFFFFF) ? &shaped_object_values(container)[i] : NULL;
+ }
+ if(MJS_Unlikely(container->flags & MJS_OBJECT_UNINDEXED) && MJSObject_BuildIndex_IMPL(container, pool))
+  return NULL;
+ if(container->flags & MJS_OBJECT_SMALL)
+  i = small_object_find(container, pool, key->str, key->str_size, 0xFFFFFFFF, 0xFFFFFFFF, 0);
+ else
+  i = hashed_object_find(container, pool, key->str, key->str_size, key->hash, 0xFFFFFFFF, 0xFFFFFFFF, 0);
+ return (i != 0xFFFFFFFF) ? &container->obj_pair_ptr[i].value : NULL;
+}
+
+/*
+ resolve several keys, out_values[i] is NULL for missing keys,
+ return the number of keys found.
+*/
+static MJS_HOT unsigned int MJSObject_GetByKeys_IMPL(MJSObject *container, MJSStringPool *pool, const MJSKey *keys, unsigned int key_count, MJSDynamicType **out_values) {
+ unsigned int i, k;
+ unsigned int found = 0;
+ const unsigned int estimated_size = MJSObject_SlotCount_IMPL(container);
+ MJSDynamicType *value;
+ MJSShapeKey key;
+
+ for(k = 0; k < key_count; k++)
+  out_values[k] = NULL;
+
+ /* shapes and hashed objects are one index probe per key */
+ if(!(container->flags & MJS_OBJECT_SMALL)) {
+  for(k = 0; k < key_count; k++) {
+   out_values[k] = MJSObject_GetByKey_IMPL(container, pool, &keys[k]);
+   found += !!out_values[k];
+  }
+  return found;
+ }
+
+ /* small objects, a single walk over the pairs */
+ for(i = 0; i < estimated_size && found < key_count; i++) {
+  value = MJSObject_SlotAt_IMPL(container, i, &key);
+  const char *pair_key = &pool->root[key.chunk_node_index].str[key.key_pool_index];
+
+  for(k = 0; k < key_count; k++) {
+   /* cheap rejects first, length then first byte */
+   if(out_values[k] || keys[k].str_size != key.key_pool_size || keys[k].str[0] != pair_key[0])
+    continue;
+   if(!memcmp(keys[k].str, pair_key, key.key_pool_size)) {
+    out_values[k] = value;
+    found++;
+    break;
+   }
+  }
+ }
+ return found;
 }
 
 
@@ -494,12 +1414,202 @@ static MJS_HOT int MJSParserData_Destroy_IMPL(MJSParsedData *parsed_data) {
  return result;
 }
 
+/*
+ give the buffers of a value and its children to the pool block cache
+*/
+static MJS_COLD void MJSDynamicType_Recycle_IMPL(MJSStringPool *pool, MJSDynamicType *value) {
+ unsigned int i, count;
+ MJSShapeKey key;
+ switch(value->type) {
+  case MJS_TYPE_ARRAY:
+   if(value->value_array.packed_type) {
+    __aligned_dealloc(value->value_array.dynamic_type_ptr);
+    break;
+   }
+   for(i = 0; i < value->value_array.size; i++)
+    MJSDynamicType_Recycle_IMPL(pool, &value->value_array.dynamic_type_ptr[i]);
+   pool_block_free(pool, value->value_array.dynamic_type_ptr, (unsigned int)sizeof(MJSDynamicType) << value->value_array.reserve);
+  break;
+  case MJS_TYPE_OBJECT:
+   count = MJSObject_SlotCount_IMPL(&value->value_object);
+   for(i = 0; i < count; i++)
+    MJSDynamicType_Recycle_IMPL(pool, MJSObject_SlotAt_IMPL(&value->value_object, i, &key));
+   pool_block_free(pool, value->value_object.obj_pair_ptr, object_block_bytes(&value->value_object));
+  break;
+ }
+}
+
+/*
+ drop the parsed document but keep its memory, options and profile stay.
+*/
+static MJS_COLD int MJSParserData_Reset_IMPL(MJSParsedData *parsed_data, MJSStringPool *pool) {
+ const unsigned int options = parsed_data->options;
+ const unsigned char duplicate_policy = parsed_data->duplicate_policy;
+ MJSParseProfile *profile = parsed_data->profile;
+
+ if(!pool->block_cache) {
+  pool->block_cache = (MJSBlockCache*)__aligned_alloc(sizeof(MJSBlockCache) * MJS_MAX_BLOCK_CACHE_SIZES);
+  if(MJS_Unlikely(!pool->block_cache))
+   return MJS_RESULT_ALLOCATION_FAILED;
+  memset(pool->block_cache, 0, sizeof(MJSBlockCache) * MJS_MAX_BLOCK_CACHE_SIZES);
+ }
+ MJSDynamicType_Recycle_IMPL(pool, &parsed_data->container);
+
+ memset(parsed_data, 0, sizeof(MJSParsedData));
+ parsed_data->options = options;
+ parsed_data->duplicate_policy = duplicate_policy;
+ parsed_data->profile = profile;
+ return 0;
+}
+
 
 /*-----------------MJSOutputStreamBuffer_Init-------------------*/
+/*
+ file and fd output go through a staging buffer held in buff, it is
+ handed to the sink in MJS_MAX_STAGING_BYTES pieces
+*/
+MJS_INLINE int output_stream_staging_init(MJSOutputStreamBuffer *buff) {
+ buff->buff_reserve = MJS_MAX_STAGING_BYTES;
+ buff->buff = (char*)__aligned_alloc(MJS_MAX_STAGING_BYTES);
+ return !buff->buff * MJS_RESULT_ALLOCATION_FAILED;
+}
+
+
+#if defined(MJS_POSIX_IO)
+/*
+ write(2) until arr is out, a short write goes on where it stopped
+*/
+static MJS_HOT int output_stream_write_fd(int fd, const char *arr, unsigned int arr_size) {
+ while(arr_size) {
+  const ssize_t written = write(fd, arr, arr_size);
+  if(MJS_Unlikely(written < 0)) {
+   if(errno == EINTR)
+    continue;
+   return MJS_RESULT_UNSUCCESSFUL_IO_WRITE;
+  }
+  arr += written;
+  arr_size -= (unsigned int)written;
+ }
+ return 0;
+}
+#endif
+
+
+#if defined(MJS_ASYNC_IO)
+/*
+ one staging buffer is in flight at a time. the flush thread owns
+ pending while it is set and hands it back as spare, the writer
+ fills buff->buff and swaps it with spare.
+*/
+typedef struct MJSAsyncSink {
+ pthread_t       thread;
+ pthread_mutex_t lock;
+ pthread_cond_t  cond;
+ char            *pending;
+ char            *spare;
+ unsigned int    pending_size;
+ int             fd;
+ int             result; /* first write error, reported on the next swap or flush */
+ int             stop;
+} MJSAsyncSink;
+
+static void* output_stream_async_main(void *arg) {
+ MJSAsyncSink *async = (MJSAsyncSink*)arg;
+ char *data;
+ int result;
+
+ pthread_mutex_lock(&async->lock);
+ for(;;) {
+  while(!async->pending && !async->stop)
+   pthread_cond_wait(&async->cond, &async->lock);
+  if(!async->pending)
+   break;
+  data = async->pending;
+  pthread_mutex_unlock(&async->lock);
+
+  result = output_stream_write_fd(async->fd, data, async->pending_size);
+
+  pthread_mutex_lock(&async->lock);
+  if(MJS_Unlikely(result) && !async->result)
+   async->result = result;
+  async->spare = data;
+  async->pending = NULL;
+  pthread_cond_broadcast(&async->cond);
+ }
+ pthread_mutex_unlock(&async->lock);
+ return NULL;
+}
+
+/*
+ block until nothing is in flight
+*/
+static MJS_HOT int output_stream_async_wait(MJSAsyncSink *async) {
+ int result;
+ pthread_mutex_lock(&async->lock);
+ while(async->pending)
+  pthread_cond_wait(&async->cond, &async->lock);
+ result = async->result;
+ pthread_mutex_unlock(&async->lock);
+ return result;
+}
+
+/*
+ hand the staged bytes to the thread, waits while the previous
+ buffer is still being written
+*/
+static MJS_HOT int output_stream_async_drain(MJSOutputStreamBuffer *buff) {
+ MJSAsyncSink *async = (MJSAsyncSink*)buff->async;
+ int result;
+ if(!buff->buff_size)
+  return 0;
+
+ pthread_mutex_lock(&async->lock);
+ while(async->pending)
+  pthread_cond_wait(&async->cond, &async->lock);
+ result = async->result;
+ if(MJS_Likely(!result)) {
+  async->pending = buff->buff;
+  async->pending_size = buff->buff_size;
+  buff->buff = async->spare;
+  async->spare = NULL;
+  pthread_cond_broadcast(&async->cond);
+ }
+ pthread_mutex_unlock(&async->lock);
+
+ buff->buff_reserve += buff->buff_size;
+ buff->buff_size = 0;
+ return result;
+}
+
+
+static MJS_COLD int output_stream_async_destroy(MJSOutputStreamBuffer *buff) {
+ MJSAsyncSink *async = (MJSAsyncSink*)buff->async;
+ int result = output_stream_async_drain(buff);
+
+ pthread_mutex_lock(&async->lock);
+ async->stop = 1;
+ pthread_cond_broadcast(&async->cond);
+ pthread_mutex_unlock(&async->lock);
+ pthread_join(async->thread, NULL);
+ if(!result)
+  result = async->result;
+
+ __aligned_dealloc(buff->buff);
+ __aligned_dealloc(async->spare);
+ pthread_cond_destroy(&async->cond);
+ pthread_mutex_destroy(&async->lock);
+ __aligned_dealloc(async);
+ return result;
+}
+#endif
+
+
 static MJS_HOT int MJSOutputStreamBuffer_Init_IMPL(MJSOutputStreamBuffer *buff, unsigned char mode, FILE* fp) {
+ int result;
  memset(buff, 0, sizeof(MJSOutputStreamBuffer));
  
  buff->mode = mode;
+ buff->fd = -1;
  
  switch(mode) {
   case MJS_WRITE_TO_MEMORY_BUFFER:
@@ -510,6 +1620,11 @@ static MJS_HOT int MJSOutputStreamBuffer_Init_IMPL(MJSOutputStreamBuffer *buff,
   break;
   case MJS_WRITE_TO_FILE:
    buff->file_ptr = fp;
+   result = output_stream_staging_init(buff);
+   if(MJS_Unlikely(result))
+    return result;
+  break;
+  case MJS_WRITE_TO_COUNTER:
   break;
   default:
    return MJS_RESULT_INVALID_WRITE_MODE;
@@ -524,54 +1639,335 @@ static MJS_HOT int MJSOutputStreamBuffer_Init_IMPL(MJSOutputStreamBuffer *buff,
 }
 
 
+static MJS_COLD int MJSOutputStreamBuffer_InitFd_IMPL(MJSOutputStreamBuffer *buff, int fd) {
+ memset(buff, 0, sizeof(MJSOutputStreamBuffer));
+#if defined(MJS_POSIX_IO)
+ buff->mode = MJS_WRITE_TO_FD;
+ buff->fd = fd;
+ if(MJS_Unlikely(output_stream_staging_init(buff)))
+  return MJS_RESULT_ALLOCATION_FAILED;
+
+ buff->cache_allocated_size = MJS_MAX_RESERVE_BYTES;
+ buff->cache = (char*)__aligned_alloc(MJS_MAX_RESERVE_BYTES);
+ if(MJS_Unlikely(!buff->cache))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ return 0;
+#else
+ (void)fd;
+ return MJS_RESULT_INVALID_WRITE_MODE;
+#endif
+}
+
+
+static MJS_COLD int MJSOutputStreamBuffer_InitFdGather_IMPL(MJSOutputStreamBuffer *buff, int fd) {
+ int result = MJSOutputStreamBuffer_InitFd_IMPL(buff, fd);
+ if(MJS_Unlikely(result))
+  return result;
+#if defined(MJS_POSIX_IO)
+ buff->mode = MJS_WRITE_TO_FD_GATHER;
+ buff->iov = __aligned_alloc(sizeof(struct iovec) * MJS_GATHER_IOV);
+ if(MJS_Unlikely(!buff->iov))
+  return MJS_RESULT_ALLOCATION_FAILED;
+#endif
+ return 0;
+}
+
+
+static MJS_COLD int MJSOutputStreamBuffer_InitFdAsync_IMPL(MJSOutputStreamBuffer *buff, int fd) {
+#if defined(MJS_ASYNC_IO)
+ MJSAsyncSink *async;
+ int result = MJSOutputStreamBuffer_InitFd_IMPL(buff, fd);
+ if(MJS_Unlikely(result))
+  return result;
+
+ async = (MJSAsyncSink*)__aligned_alloc(sizeof(MJSAsyncSink));
+ if(MJS_Unlikely(!async))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ memset(async, 0, sizeof(MJSAsyncSink));
+ async->fd = fd;
+ async->spare = (char*)__aligned_alloc(MJS_MAX_STAGING_BYTES);
+ if(MJS_Unlikely(!async->spare)) {
+  __aligned_dealloc(async);
+  return MJS_RESULT_ALLOCATION_FAILED;
+ }
+
+ pthread_mutex_init(&async->lock, NULL);
+ pthread_cond_init(&async->cond, NULL);
+ if(MJS_Unlikely(pthread_create(&async->thread, NULL, output_stream_async_main, async))) {
+  pthread_cond_destroy(&async->cond);
+  pthread_mutex_destroy(&async->lock);
+  __aligned_dealloc(async->spare);
+  __aligned_dealloc(async);
+  return MJS_RESULT_ALLOCATION_FAILED;
+ }
+ buff->mode = MJS_WRITE_TO_FD_ASYNC;
+ buff->async = async;
+ return 0;
+#else
+ (void)fd;
+ memset(buff, 0, sizeof(MJSOutputStreamBuffer));
+ return MJS_RESULT_INVALID_WRITE_MODE;
+#endif
+}
+
+
+static MJS_COLD int MJSOutputStreamBuffer_InitFixed_IMPL(MJSOutputStreamBuffer *buff, char *arr, unsigned int arr_size) {
+ memset(buff, 0, sizeof(MJSOutputStreamBuffer));
+ if(MJS_Unlikely(!arr_size))
+  return MJS_RESULT_BUFFER_TOO_SMALL;
+ buff->mode = MJS_WRITE_TO_FIXED_BUFFER;
+ buff->fd = -1;
+ buff->buff = arr;
+ /* one byte stays free for the NUL */
+ buff->buff_reserve = arr_size - 1;
+
+ buff->cache_allocated_size = MJS_MAX_RESERVE_BYTES;
+ buff->cache = (char*)__aligned_alloc(MJS_MAX_RESERVE_BYTES);
+ if(MJS_Unlikely(!buff->cache))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ return 0;
+}
+
+
+static MJS_HOT int MJSOutputStreamBuffer_Drain_IMPL(MJSOutputStreamBuffer *buff);
+
 static MJS_HOT int MJSOutputStreamBuffer_Destroy_IMPL(MJSOutputStreamBuffer *buff) {
+ int result = 0;
  switch(buff->mode) {
   case MJS_WRITE_TO_MEMORY_BUFFER:
    __aligned_dealloc(buff->buff);
   break;
+  case MJS_WRITE_TO_FIXED_BUFFER:
+  case MJS_WRITE_TO_COUNTER:
+  break;
+#if defined(MJS_ASYNC_IO)
+  case MJS_WRITE_TO_FD_ASYNC:
+   result = output_stream_async_destroy(buff);
+  break;
+#endif
   case MJS_WRITE_TO_FILE:
-   if(MJS_Unlikely(!buff->file_ptr))
-    return MJS_RESULT_NULL_POINTER;
+  case MJS_WRITE_TO_FD:
+  case MJS_WRITE_TO_FD_GATHER:
+   /* whatever is still staged goes out first */
+   result = MJSOutputStreamBuffer_Drain_IMPL(buff);
+   __aligned_dealloc(buff->buff);
+   if(buff->iov)
+    __aligned_dealloc(buff->iov);
+   if(MJS_Unlikely(buff->mode == MJS_WRITE_TO_FILE && !buff->file_ptr))
+    result = MJS_RESULT_NULL_POINTER;
   break;
   default:
    return MJS_RESULT_INVALID_WRITE_MODE;
   break;
  }
  __aligned_dealloc(buff->cache);
+ return result;
+}
+
+
+/*
+ rewind to empty, the memory buffer keeps its capacity,
+ staged file and fd output is dropped
+*/
+static MJS_COLD int MJSOutputStreamBuffer_Reset_IMPL(MJSOutputStreamBuffer *buff) {
+ switch(buff->mode) {
+  case MJS_WRITE_TO_MEMORY_BUFFER:
+  case MJS_WRITE_TO_FIXED_BUFFER:
+   buff->buff_reserve += buff->buff_size;
+   buff->buff_size = 0;
+   buff->buff[0] = '\0';
+  break;
+  case MJS_WRITE_TO_COUNTER:
+   buff->buff_size = 0;
+  break;
+  case MJS_WRITE_TO_FILE:
+  case MJS_WRITE_TO_FD:
+  case MJS_WRITE_TO_FD_GATHER:
+  case MJS_WRITE_TO_FD_ASYNC:
+   buff->buff_reserve += buff->buff_size;
+   buff->buff_size = 0;
+   buff->iov_count = 0;
+  break;
+  default:
+   return MJS_RESULT_INVALID_WRITE_MODE;
+  break;
+ }
+ buff->cache_size = 0;
+ return 0;
+}
+
+/*
+ hand arr straight to the file or fd, write(2) may take less than asked
+*/
+static MJS_HOT int MJSOutputStreamBuffer_Sink_IMPL(MJSOutputStreamBuffer *buff, const char *arr, unsigned int arr_size) {
+ if(buff->mode == MJS_WRITE_TO_FILE) {
+  if(MJS_Unlikely(!buff->file_ptr))
+   return MJS_RESULT_NULL_POINTER;
+  if(MJS_Unlikely(fwrite(arr, sizeof(char), arr_size, buff->file_ptr) != arr_size))
+   return MJS_RESULT_UNSUCCESSFUL_IO_WRITE;
+  return 0;
+ }
+#if defined(MJS_ASYNC_IO)
+ /* the flush thread finishes first, output stays in order */
+ if(buff->mode == MJS_WRITE_TO_FD_ASYNC) {
+  const int result = output_stream_async_wait((MJSAsyncSink*)buff->async);
+  if(MJS_Unlikely(result))
+   return result;
+ }
+#endif
+#if defined(MJS_POSIX_IO)
+ return output_stream_write_fd(buff->fd, arr, arr_size);
+#else
+ return MJS_RESULT_INVALID_WRITE_MODE;
+#endif
+}
+
+
+#if defined(MJS_POSIX_IO)
+/*
+ add arr_size bytes at arr to the iovec list, bytes that continue
+ the last entry extend it
+*/
+MJS_INLINE void output_stream_gather(MJSOutputStreamBuffer *buff, const char *arr, unsigned int arr_size) {
+ struct iovec *iov = (struct iovec*)buff->iov;
+ const unsigned int count = buff->iov_count;
+ if(count && (const char*)iov[count-1].iov_base + iov[count-1].iov_len == arr) {
+  iov[count-1].iov_len += arr_size;
+  return;
+ }
+ iov[count].iov_base = (void*)arr;
+ iov[count].iov_len = arr_size;
+ buff->iov_count++;
+}
+
+/*
+ writev the list, a short write resumes inside the entry it stopped in
+*/
+static MJS_HOT int output_stream_gather_drain(MJSOutputStreamBuffer *buff) {
+ struct iovec *iov = (struct iovec*)buff->iov;
+ unsigned int count = buff->iov_count;
+ ssize_t written;
+ int result = 0;
+
+ while(count) {
+  written = writev(buff->fd, iov, (int)count);
+  if(MJS_Unlikely(written < 0)) {
+   if(errno == EINTR)
+    continue;
+   result = MJS_RESULT_UNSUCCESSFUL_IO_WRITE;
+   break;
+  }
+  for(; count && (size_t)written >= iov->iov_len; iov++, count--)
+   written -= (ssize_t)iov->iov_len;
+  if(count) {
+   iov->iov_base = (char*)iov->iov_base + written;
+   iov->iov_len -= (size_t)written;
+  }
+ }
+ buff->iov_count = 0;
+ buff->buff_reserve += buff->buff_size;
+ buff->buff_size = 0;
+ return result;
+}
+#endif
+
+/*
+ pass the staged bytes on and empty the staging buffer
+*/
+static MJS_HOT int MJSOutputStreamBuffer_Drain_IMPL(MJSOutputStreamBuffer *buff) {
+ int result;
+#if defined(MJS_POSIX_IO)
+ if(buff->mode == MJS_WRITE_TO_FD_GATHER)
+  return output_stream_gather_drain(buff);
+#endif
+#if defined(MJS_ASYNC_IO)
+ if(buff->mode == MJS_WRITE_TO_FD_ASYNC)
+  return output_stream_async_drain(buff);
+#endif
+ if(!buff->buff_size)
+  return 0;
+ result = MJSOutputStreamBuffer_Sink_IMPL(buff, buff->buff, buff->buff_size);
+ buff->buff_reserve += buff->buff_size;
+ buff->buff_size = 0;
+ return result;
+}
+
+
+/*
+ room for size more bytes and the NUL in the memory buffer
+*/
+static MJS_HOT int MJSOutputStreamBuffer_Reserve_IMPL(MJSOutputStreamBuffer *buff, unsigned int size) {
+ const unsigned int capacity = buff->buff_size + size + 1;
+ char *memory;
+ if(size < buff->buff_reserve)
+  return 0;
+ memory = (char*)__aligned_realloc(buff->buff, capacity);
+ if(MJS_Unlikely(!memory))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ buff->buff = memory;
+ buff->buff_reserve = capacity - buff->buff_size;
  return 0;
 }
 
 
 static MJS_HOT int MJSOutputStreamBuffer_Write_IMPL(MJSOutputStreamBuffer *buff, char *arr, unsigned int arr_size) {
- unsigned int elements;
+ unsigned int capacity;
+ int result;
  
  switch(buff->mode) {
   case MJS_WRITE_TO_MEMORY_BUFFER:
-   if((arr_size+1) > buff->buff_reserve) {
-    buff->buff = (char*)__aligned_realloc(buff->buff, sizeof(char) * (buff->buff_size + buff->buff_reserve + MJS_MAX_RESERVE_BYTES));
-    if(MJS_Unlikely(!buff->buff))
-     return MJS_RESULT_ALLOCATION_FAILED;
-    buff->buff_reserve += MJS_MAX_RESERVE_BYTES;
-    memcpy(&buff->buff[buff->buff_size], arr, arr_size);
-    buff->buff[buff->buff_size+arr_size] = '\0';
-
-    buff->buff_size += arr_size;
-    buff->buff_reserve -= arr_size;
-   } else { 
-    memcpy(&buff->buff[buff->buff_size], arr, arr_size);
-    buff->buff[buff->buff_size+arr_size] = '\0';
-
-    buff->buff_size += arr_size;
-    buff->buff_reserve -= arr_size;
+   /* the NUL is only written on flush, one byte is kept for it */
+   if(MJS_Unlikely(arr_size >= buff->buff_reserve)) {
+    /* at least double, a run of small writes reallocates log n times */
+    capacity = buff->buff_size + buff->buff_reserve;
+    result = MJSOutputStreamBuffer_Reserve_IMPL(buff, (arr_size > capacity) ? arr_size : capacity);
+    if(MJS_Unlikely(result))
+     return result;
    }
+   memcpy(&buff->buff[buff->buff_size], arr, arr_size);
+   buff->buff_size += arr_size;
+   buff->buff_reserve -= arr_size;
+  break;
+  case MJS_WRITE_TO_FIXED_BUFFER:
+   if(MJS_Unlikely(arr_size > buff->buff_reserve))
+    return MJS_RESULT_BUFFER_TOO_SMALL;
+   memcpy(&buff->buff[buff->buff_size], arr, arr_size);
+   buff->buff_size += arr_size;
+   buff->buff_reserve -= arr_size;
+  break;
+  case MJS_WRITE_TO_COUNTER:
+   buff->buff_size += arr_size;
   break;
   case MJS_WRITE_TO_FILE:
-   if(MJS_Unlikely(!buff->file_ptr))
-    return MJS_RESULT_NULL_POINTER;
-   elements = (unsigned int)fwrite(arr, sizeof(char), arr_size, buff->file_ptr);
-   if(MJS_Unlikely(elements != arr_size))
-    return MJS_RESULT_UNSUCCESSFUL_IO_WRITE;
+  case MJS_WRITE_TO_FD:
+  case MJS_WRITE_TO_FD_ASYNC:
+   if(MJS_Unlikely(arr_size > buff->buff_reserve)) {
+    result = MJSOutputStreamBuffer_Drain_IMPL(buff);
+    if(MJS_Unlikely(result))
+     return result;
+    /* too big to stage, it goes out as is */
+    if(arr_size > buff->buff_reserve)
+     return MJSOutputStreamBuffer_Sink_IMPL(buff, arr, arr_size);
+   }
+   memcpy(&buff->buff[buff->buff_size], arr, arr_size);
+   buff->buff_size += arr_size;
+   buff->buff_reserve -= arr_size;
   break;
+#if defined(MJS_POSIX_IO)
+  case MJS_WRITE_TO_FD_GATHER:
+   if(MJS_Unlikely(arr_size > buff->buff_reserve || buff->iov_count == MJS_GATHER_IOV)) {
+    result = output_stream_gather_drain(buff);
+    if(MJS_Unlikely(result))
+     return result;
+    if(arr_size > buff->buff_reserve)
+     return MJSOutputStreamBuffer_Sink_IMPL(buff, arr, arr_size);
+   }
+   output_stream_gather(buff, &buff->buff[buff->buff_size], arr_size);
+   memcpy(&buff->buff[buff->buff_size], arr, arr_size);
+   buff->buff_size += arr_size;
+   buff->buff_reserve -= arr_size;
+  break;
+#endif
   default:
    return MJS_RESULT_INVALID_WRITE_MODE;
   break;
@@ -581,14 +1977,32 @@ static MJS_HOT int MJSOutputStreamBuffer_Write_IMPL(MJSOutputStreamBuffer *buff,
 
 
 static MJS_HOT int MJSOutputStreamBuffer_Flush_IMPL(MJSOutputStreamBuffer *buff) {
+ int result;
  switch(buff->mode) {
   case MJS_WRITE_TO_MEMORY_BUFFER:
+  case MJS_WRITE_TO_FIXED_BUFFER:
+   buff->buff[buff->buff_size] = '\0';
+  break;
+  case MJS_WRITE_TO_COUNTER:
   break;
   case MJS_WRITE_TO_FILE:
    if(MJS_Unlikely(!buff->file_ptr))
     return MJS_RESULT_NULL_POINTER;
+   result = MJSOutputStreamBuffer_Drain_IMPL(buff);
+   if(MJS_Unlikely(result))
+    return result;
    fflush(buff->file_ptr);
   break;
+  case MJS_WRITE_TO_FD:
+  case MJS_WRITE_TO_FD_GATHER:
+   return MJSOutputStreamBuffer_Drain_IMPL(buff);
+#if defined(MJS_ASYNC_IO)
+  case MJS_WRITE_TO_FD_ASYNC:
+   result = MJSOutputStreamBuffer_Drain_IMPL(buff);
+   if(MJS_Unlikely(result))
+    return result;
+   return output_stream_async_wait((MJSAsyncSink*)buff->async);
+#endif
   default:
    return MJS_RESULT_INVALID_WRITE_MODE;
   break;
@@ -596,6 +2010,45 @@ static MJS_HOT int MJSOutputStreamBuffer_Flush_IMPL(MJSOutputStreamBuffer *buff)
  return 0;
 }
 
+/*
+ gather mode points an iovec at arr instead of copying it, short
+ pieces are cheaper to copy and everything else goes through Write
+*/
+static MJS_HOT int MJSOutputStreamBuffer_WriteRef_IMPL(MJSOutputStreamBuffer *buff, const char *arr, unsigned int arr_size) {
+#if defined(MJS_POSIX_IO)
+ int result;
+ if(buff->mode == MJS_WRITE_TO_FD_GATHER && arr_size >= MJS_MIN_GATHER_REF_BYTES) {
+  if(MJS_Unlikely(buff->iov_count == MJS_GATHER_IOV)) {
+   result = output_stream_gather_drain(buff);
+   if(MJS_Unlikely(result))
+    return result;
+  }
+  output_stream_gather(buff, arr, arr_size);
+  return 0;
+ }
+#endif
+ return MJSOutputStreamBuffer_Write_IMPL(buff, (char*)arr, arr_size);
+}
+
+
+/*
+ make room for size bytes in the cache, at least doubling it
+*/
+static MJS_HOT int MJSOutputStreamBuffer_ReserveCache_IMPL(MJSOutputStreamBuffer *buff, unsigned int size) {
+ unsigned int allocated = buff->cache_allocated_size << 1;
+ char *cache;
+ if(MJS_Likely(size <= buff->cache_allocated_size))
+  return 0;
+ if(allocated < size)
+  allocated = size;
+ cache = (char*)__aligned_realloc(buff->cache, allocated);
+ if(MJS_Unlikely(!cache))
+  return MJS_RESULT_ALLOCATION_FAILED;
+ buff->cache = cache;
+ buff->cache_allocated_size = allocated;
+ return 0;
+}
+
 
 static MJS_HOT int MJSOutputStreamBuffer_ExpandCache_IMPL(MJSOutputStreamBuffer *buff) {  
  buff->cache = (char*)__aligned_realloc(buff->cache, (buff->cache_allocated_size + MJS_MAX_RESERVE_BYTES));
@@ -59,6 +59,17 @@ const unsigned char mjs__bruijin_numbers[32] = {
  12, 18, 6, 11, 
  5, 10, 9
 };
+
+const unsigned char mjs__bruijin_numbers64[64] = {
+ 0, 1, 48, 2, 57, 49, 28, 3,
+ 61, 58, 50, 42, 38, 29, 17, 4,
+ 62, 55, 59, 36, 53, 51, 43, 22,
+ 45, 39, 33, 30, 24, 18, 12, 5,
+ 63, 47, 56, 27, 60, 41, 37, 16,
+ 54, 35, 52, 21, 44, 32, 23, 11,
+ 46, 26, 40, 15, 34, 20, 31, 10,
+ 25, 14, 19, 9, 13, 8, 7, 6
+};
  
 const char mjs__hex_table[255] = {
  0, 0, 0, 0, 0, 0, 0, 0,
@@ -95,79 +106,243 @@ const char mjs__hex_table[255] = {
  0, 0, 0, 0, 0, 0, 0,
 };
 /*
- string writer
+ escape scanning, find the next byte that cannot be copied as is:
+ '"', '\\', control characters below 0x20 and, for ascii only output,
+ every non ascii byte. 16 bytes per step with sse2 or neon, 8 with
+ plain 64 bit words.
 */
-MJS_HOT int MJS_WriteStringToCache(MJSOutputStreamBuffer *buff, const char *str, unsigned int str_size) {
- const char *begin_ptr = str;
- const char *end_ptr = str+str_size;
- int result = 0;
- buff->cache_size = 0;
- int advance = 0;
- int unicode = 0;
- buff->cache[buff->cache_size++] = '\"';
-
- while(begin_ptr < end_ptr) {
-  
-  /* make sure no overflow */
-  if(MJS_Unlikely((buff->cache_size+5) > buff->cache_allocated_size)) {
-   result = MJSOutputStreamBuffer_ExpandCache(buff);
+#define MJS_NeedsEscape(c, ascii_only) ((c) < 0x20 || (c) == '\"' || (c) == '\\' || ((ascii_only) && (c) >= 0x80))
+
+MJS_INLINE const unsigned char* escape_scan_tail(const unsigned char *p, const unsigned char *end, int ascii_only) {
+ while(p < end && !MJS_NeedsEscape(*p, ascii_only))
+  p++;
+ return p;
+}
+
+#if defined(MJS_FORCE_VECTORIZE) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+
+MJS_INLINE const unsigned char* escape_scan(const unsigned char *p, const unsigned char *end, int ascii_only) {
+ const __m128i quote = _mm_set1_epi8('\"');
+ const __m128i backslash = _mm_set1_epi8('\\');
+ const __m128i control = _mm_set1_epi8(0x1F);
+ __m128i v, m;
+ int mask;
+ for(; p + 16 <= end; p += 16) {
+  v = _mm_loadu_si128((const __m128i*)p);
+  /* unsigned v <= 0x1F, the high bits of v are the non ascii bytes */
+  m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)), _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+  mask = _mm_movemask_epi8(m) | (ascii_only ? _mm_movemask_epi8(v) : 0);
+  if(mask)
+   return p + MJS_CountTrailingZeroes(mask);
+ }
+ return escape_scan_tail(p, end, ascii_only);
+}
+
+#elif defined(MJS_FORCE_VECTORIZE) && defined(__aarch64__)
+#include <arm_neon.h>
+
+MJS_INLINE const unsigned char* escape_scan(const unsigned char *p, const unsigned char *end, int ascii_only) {
+ const uint8x16_t quote = vdupq_n_u8('\"');
+ const uint8x16_t backslash = vdupq_n_u8('\\');
+ const uint8x16_t space = vdupq_n_u8(0x20);
+ const uint8x16_t high = vdupq_n_u8(0x80);
+ /* bytes from 0x80 up only count for ascii only output */
+ const uint8x16_t high_mask = vdupq_n_u8(ascii_only ? 0xFF : 0x00);
+ uint8x16_t v, m;
+ MJS_Uint64 bits;
+ for(; p + 16 <= end; p += 16) {
+  v = vld1q_u8(p);
+  m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)), vorrq_u8(vcltq_u8(v, space), vandq_u8(vcgeq_u8(v, high), high_mask)));
+  /* narrow to 4 bits per byte, the first hit is the lowest nibble set */
+  bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+  if(bits)
+   return p + (MJS_CountTrailingZeroes64(bits) >> 2);
+ }
+ return escape_scan_tail(p, end, ascii_only);
+}
+
+#else
+
+#define MJS_SWAR_ONES  0x0101010101010101ull
+#define MJS_SWAR_HIGHS 0x8080808080808080ull
+
+/* high bit of every byte of x below n, n <= 0x80 */
+#define MJS_SwarLess(x, n) (((x) - MJS_SWAR_ONES * (n)) & ~(x) & MJS_SWAR_HIGHS)
+
+MJS_INLINE const unsigned char* escape_scan(const unsigned char *p, const unsigned char *end, int ascii_only) {
+ const MJS_Uint64 high = ascii_only ? MJS_SWAR_HIGHS : 0;
+ MJS_Uint64 x, quote, backslash;
+ for(; p + 8 <= end; p += 8) {
+  memcpy(&x, p, sizeof(MJS_Uint64));
+  quote = x ^ (MJS_SWAR_ONES * '\"');
+  backslash = x ^ (MJS_SWAR_ONES * '\\');
+  /* may flag bytes after a real hit, the tail scan finds the exact one */
+  if(MJS_SwarLess(x, 0x20) | MJS_SwarLess(quote, 1) | MJS_SwarLess(backslash, 1) | (x & high))
+   return escape_scan_tail(p, p + 8, ascii_only);
+ }
+ return escape_scan_tail(p, end, ascii_only);
+}
+
+#endif
+
+/* second escape character, 'u' for \u00XX, 0 when the byte is copied */
+static const char mjs__escape_table[128] = {
+ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+ 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+ 0, 0, '\"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char mjs__hex_digits[16] = {
+ '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+/* longest escape of one code point, a surrogate pair */
+#define MJS_MAX_ESCAPE_BYTES 12
+
+MJS_INLINE unsigned int write_unicode_escape(char *out, unsigned int code) {
+ out[0] = '\\';
+ out[1] = 'u';
+ out[2] = mjs__hex_digits[(code >> 12) & 0xF];
+ out[3] = mjs__hex_digits[(code >> 8) & 0xF];
+ out[4] = mjs__hex_digits[(code >> 4) & 0xF];
+ out[5] = mjs__hex_digits[code & 0xF];
+ return 6;
+}
+
+/*
+ decode one utf-8 sequence, return its size or 0 when it is
+ malformed or cut off by the end of the string
+*/
+MJS_INLINE unsigned int utf8_decode(const unsigned char *p, const unsigned char *end, unsigned int *code) {
+ unsigned int size, i;
+ unsigned int c = p[0];
+ if(c >= 0xF0 && c <= 0xF4) {
+  size = 4;
+  c &= 0x07;
+ } else if(c >= 0xE0 && c < 0xF0) {
+  size = 3;
+  c &= 0x0F;
+ } else if(c >= 0xC2 && c < 0xE0) {
+  size = 2;
+  c &= 0x1F;
+ } else {
+  return 0;
+ }
+ if(MJS_Unlikely((unsigned int)(end - p) < size))
+  return 0;
+ for(i = 1; i < size; i++) {
+  if(MJS_Unlikely((p[i] & 0xC0) != 0x80))
+   return 0;
+  c = (c << 6) | (p[i] & 0x3F);
+ }
+ /* overlong, surrogate halves and beyond U+10FFFF */
+ if(MJS_Unlikely((size == 3 && c < 0x800) || (size == 4 && (c < 0x10000 || c > 0x10FFFF)) || (c >= 0xD800 && c <= 0xDFFF)))
+  return 0;
+ *code = c;
+ return size;
+}
+
+MJS_HOT int MJS_StringNeedsEscape(const char *str, unsigned int str_size, int ascii_only) {
+ const unsigned char *end = (const unsigned char*)str + str_size;
+ return escape_scan((const unsigned char*)str, end, ascii_only) != end;
+}
+
+/*
+ every escape replaces the bytes it stands for, only those are looked at
+*/
+MJS_HOT unsigned int MJS_StringEscapedSize(const char *str, unsigned int str_size, int ascii_only) {
+ const unsigned char *p = (const unsigned char*)str;
+ const unsigned char *end = p + str_size;
+ unsigned int size = str_size + 2;
+ unsigned int code, advance;
+
+ while((p = escape_scan(p, end, ascii_only)) != end) {
+  if(*p < 0x80) {
+   size += (mjs__escape_table[*p] == 'u') ? 5 : 1;
+   p++;
+  } else {
+   advance = utf8_decode(p, end, &code);
+   if(MJS_Unlikely(!advance)) {
+    code = 0xFFFD;
+    advance = 1;
+   }
+   size += ((code >= 0x10000) ? 12 : 6) - advance;
+   p += advance;
+  }
+ }
+ return size;
+}
+
+/*
+ string writer, clean runs are found by escape_scan and copied in one
+ go. the cache is sized once for the string as is, only strings with
+ escapes grow it on the way. utf-8 is copied verbatim unless ascii_only,
+ it is not validated then.
+*/
+MJS_HOT int MJS_WriteStringToCache(MJSOutputStreamBuffer *buff, const char *str, unsigned int str_size, int ascii_only) {
+ const unsigned char *p = (const unsigned char*)str;
+ const unsigned char *end = p + str_size;
+ const unsigned char *run;
+ unsigned int size = 0;
+ unsigned int run_size, code, advance;
+ char escape;
+ int result;
+
+ result = MJSOutputStreamBuffer_ReserveCache_IMPL(buff, str_size + MJS_MAX_ESCAPE_BYTES + 2);
+ if(MJS_Unlikely(result))
+  return result;
+ buff->cache[size++] = '\"';
+
+ while(p < end) {
+  run = p;
+  p = escape_scan(p, end, ascii_only);
+  run_size = (unsigned int)(p - run);
+  /* the run, one escape and the closing quote */
+  if(MJS_Unlikely(size + run_size + MJS_MAX_ESCAPE_BYTES + 1 > buff->cache_allocated_size)) {
+   result = MJSOutputStreamBuffer_ReserveCache_IMPL(buff, size + (unsigned int)(end - run) + MJS_MAX_ESCAPE_BYTES + 1);
    if(MJS_Unlikely(result))
     return result;
   }
-  
-  /*
-   convert some ascii back to the json escape sequence equivalent
-  */
-  switch(*begin_ptr) {
-   case '\\':
-    buff->cache[buff->cache_size++] = '\\';
-    buff->cache[buff->cache_size++] = '\\';
-    begin_ptr++;
-   break;
-   case '\n':
-    buff->cache[buff->cache_size++] = '\\';
-    buff->cache[buff->cache_size++] = 'n';
-    begin_ptr++;
-   break;
-   case '\"':
-    buff->cache[buff->cache_size++] = '\\';
-    buff->cache[buff->cache_size++] = '\"';
-    begin_ptr++;
-   break;
-   case '\b':
-    buff->cache[buff->cache_size++] = '\\';
-    buff->cache[buff->cache_size++] = 'b';
-    begin_ptr++;
-   break;
-   case '\r':
-    buff->cache[buff->cache_size++] = '\\';
-    buff->cache[buff->cache_size++] = 'r';
-    begin_ptr++;
-   break;
-   case '\t':
-    buff->cache[buff->cache_size++] = '\\';
-    buff->cache[buff->cache_size++] = 't';
-    begin_ptr++;
-   break;
-   default:
-    if(MJS_Unlikely(MJS_CheckUnicode(begin_ptr[0], begin_ptr[1]))) {
-     /*
-     if(MJS_Unlikely(!(begin_ptr+3 < end_ptr)))
-      return MJS_RESULT_INCOMPLETE_STRING_SYNTAX;
-     */
-     unicode = MJS_UTF8ToUnicode(begin_ptr, &advance);
-     sprintf(&buff->cache[buff->cache_size], "\\u%04x", unicode);
-     buff->cache_size += advance+3;
-     begin_ptr += advance;
-    }
+  memcpy(&buff->cache[size], run, run_size);
+  size += run_size;
+  if(p == end)
    break;
+
+  if(*p < 0x80) {
+   escape = mjs__escape_table[*p];
+   if(escape == 'u') {
+    size += write_unicode_escape(&buff->cache[size], *p);
+   } else {
+    buff->cache[size++] = '\\';
+    buff->cache[size++] = escape;
+   }
+   p++;
+  } else {
+   /* only ascii only output stops at non ascii bytes */
+   advance = utf8_decode(p, end, &code);
+   if(MJS_Unlikely(!advance)) {
+    /* malformed bytes become U+FFFD one at a time */
+    code = 0xFFFD;
+    advance = 1;
+   }
+   if(code >= 0x10000) {
+    code -= 0x10000;
+    size += write_unicode_escape(&buff->cache[size], 0xD800 | (code >> 10));
+    size += write_unicode_escape(&buff->cache[size], 0xDC00 | (code & 0x3FF));
+   } else {
+    size += write_unicode_escape(&buff->cache[size], code);
+   }
+   p += advance;
   }
-  buff->cache[buff->cache_size] = *begin_ptr;
-  buff->cache_size++;
-  begin_ptr++;
  }
- buff->cache[buff->cache_size++] = '\"';
-
+ buff->cache[size++] = '\"';
+ buff->cache_size = size;
  return 0;
 }
 
@@ -19,6 +19,7 @@ extern const double *mjs__exp10;
 extern const char mjs__hex_table[255];
 
 extern const unsigned char mjs__bruijin_numbers[32];
+extern const unsigned char mjs__bruijin_numbers64[64];
 
 /*
  convert unicode hex unsigned int into char array
@@ -111,7 +112,14 @@ MJS_INLINE MJS_Int64 MJS_TruncuateFractional(MJS_Int64 fractional, char *count)
 }
 
 
-MJS_HOT int MJS_WriteStringToCache(MJSOutputStreamBuffer *buff, const char *str, unsigned int str_size);
+/* quoted and escaped str into the cache, ascii_only turns non ascii into \u escapes */
+MJS_HOT int MJS_WriteStringToCache(MJSOutputStreamBuffer *buff, const char *str, unsigned int str_size, int ascii_only);
+
+/* nonzero when str can not be written between quotes as is */
+MJS_HOT int MJS_StringNeedsEscape(const char *str, unsigned int str_size, int ascii_only);
+
+/* size of what MJS_WriteStringToCache writes for str, quotes included */
+MJS_HOT unsigned int MJS_StringEscapedSize(const char *str, unsigned int str_size, int ascii_only);
 
 /* parse number and write it into cache */
 MJS_HOT int MJS_ParseNumber(MJSParsedData *parsed_data, MJSDynamicType *type);
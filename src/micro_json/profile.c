@@ -0,0 +1,81 @@
+#include "micro_json/profile.h"
+#include "micro_json/object_impl.h"
+
+/*-----------------Static func-------------------*/
+
+/*
+ the first parse sets the hint, later ones move it a quarter of the way
+*/
+MJS_INLINE unsigned int profile_blend(unsigned int hint, unsigned int observed, unsigned int parse_count) {
+ if(!parse_count)
+  return observed;
+ return (unsigned int)(((MJS_Uint64)hint * 3 + observed) >> 2);
+}
+
+/*-----------------Profile func-------------------*/
+
+MJS_COLD int MJSParseProfile_Init(MJSParseProfile *profile) {
+ if(MJS_Unlikely(!profile))
+  return MJS_RESULT_NULL_POINTER;
+ memset(profile, 0, sizeof(MJSParseProfile));
+ return 0;
+}
+
+
+MJS_COLD int MJSParserData_SetProfile(MJSParsedData *parsed_data, MJSParseProfile *profile) {
+ if(MJS_Unlikely(!parsed_data))
+  return MJS_RESULT_NULL_POINTER;
+ parsed_data->profile = profile;
+ return 0;
+}
+
+
+MJS_COLD int MJSParseProfile_Learn(MJSParseProfile *profile, MJSStringPool *pool) {
+ MJSParseProfileLevel *level;
+ unsigned int i;
+ unsigned int pool_bytes = 0;
+
+ if(MJS_Unlikely(!profile || !pool))
+  return MJS_RESULT_NULL_POINTER;
+
+ for(i = 0; i <= MJS_MAX_NESTED_VALUE; i++) {
+  level = &profile->levels[i];
+  /* depths without containers this time keep their hints */
+  if(level->array_count)
+   level->array_size = profile_blend(level->array_size, level->array_total / level->array_count, profile->parse_count);
+  if(level->object_count)
+   level->object_size = profile_blend(level->object_size, level->object_total / level->object_count, profile->parse_count);
+  level->array_total = level->array_count = 0;
+  level->object_total = level->object_count = 0;
+ }
+
+ for(i = 0; i < pool->node_size; i++)
+  pool_bytes += pool->root[i].pool_size;
+ profile->pool_bytes = profile_blend(profile->pool_bytes, pool_bytes, profile->parse_count);
+ profile->parse_count++;
+ return 0;
+}
+
+
+MJS_COLD int MJSParseProfile_Begin(MJSParseProfile *profile, MJSStringPool *pool) {
+ MJSStringPoolNode *node;
+ unsigned int i, want;
+
+ if(MJS_Unlikely(!profile || !pool))
+  return MJS_RESULT_NULL_POINTER;
+ /* a failed parse leaves its totals behind */
+ for(i = 0; i <= MJS_MAX_NESTED_VALUE; i++) {
+  profile->levels[i].array_total = profile->levels[i].array_count = 0;
+  profile->levels[i].object_total = profile->levels[i].object_count = 0;
+ }
+
+ node = &pool->root[0];
+ if(pool->node_size != 1 || node->pool_size)
+  return 0;
+
+ /* 1/8 of slack, so an average document stays in one chunk */
+ want = profile->pool_bytes + (profile->pool_bytes >> 3);
+ if(want <= node->pool_reserve)
+  return 0;
+ return MJSStringPool_ExpandNode_IMPL(node, want - node->pool_reserve);
+}
@@ -0,0 +1,446 @@
+#include "micro_json/reduce.h"
+#include "micro_json/object_impl.h"
+#include <float.h>
+
+/*
+ two double lanes, packed float/double arrays and unpacked arrays of a
+ single number type are reduced 8 elements per iteration into 4
+ independent accumulators, mixed arrays go one by one.
+*/
+#if defined(MJS_FORCE_VECTORIZE) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+
+typedef __m128d MJSVec2d;
+
+#define Vec2d_Set1(x)      _mm_set1_pd(x)
+#define Vec2d_Load(p)      _mm_loadu_pd(p)
+#define Vec2d_Set2(lo, hi) _mm_set_pd(hi, lo)
+#define Vec2d_LoadFloat(p) _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)(p))))
+#define Vec2d_Add(a, b)    _mm_add_pd(a, b)
+#define Vec2d_Mul(a, b)    _mm_mul_pd(a, b)
+#define Vec2d_Min(a, b)    _mm_min_pd(a, b)
+#define Vec2d_Max(a, b)    _mm_max_pd(a, b)
+#define Vec2d_Store(p, a)  _mm_storeu_pd(p, a)
+
+#elif defined(MJS_FORCE_VECTORIZE) && defined(__aarch64__)
+#include <arm_neon.h>
+
+typedef float64x2_t MJSVec2d;
+
+#define Vec2d_Set1(x)      vdupq_n_f64(x)
+#define Vec2d_Load(p)      vld1q_f64(p)
+#define Vec2d_Set2(lo, hi) vcombine_f64(vdup_n_f64(lo), vdup_n_f64(hi))
+#define Vec2d_LoadFloat(p) vcvt_f64_f32(vld1_f32(p))
+#define Vec2d_Add(a, b)    vaddq_f64(a, b)
+#define Vec2d_Mul(a, b)    vmulq_f64(a, b)
+#define Vec2d_Min(a, b)    vminq_f64(a, b)
+#define Vec2d_Max(a, b)    vmaxq_f64(a, b)
+#define Vec2d_Store(p, a)  vst1q_f64(p, a)
+
+#else
+
+typedef struct {
+ double v0;
+ double v1;
+} MJSVec2d;
+
+MJS_INLINE MJSVec2d Vec2d_Make(double v0, double v1) {
+ MJSVec2d r;
+ r.v0 = v0;
+ r.v1 = v1;
+ return r;
+}
+
+#define Vec2d_Set1(x)      Vec2d_Make(x, x)
+#define Vec2d_Load(p)      Vec2d_Make((p)[0], (p)[1])
+#define Vec2d_Set2(lo, hi) Vec2d_Make(lo, hi)
+#define Vec2d_LoadFloat(p) Vec2d_Make((double)(p)[0], (double)(p)[1])
+#define Vec2d_Add(a, b)    Vec2d_Make((a).v0 + (b).v0, (a).v1 + (b).v1)
+#define Vec2d_Mul(a, b)    Vec2d_Make((a).v0 * (b).v0, (a).v1 * (b).v1)
+#define Vec2d_Min(a, b)    Vec2d_Make(Scalar_Min((a).v0, (b).v0), Scalar_Min((a).v1, (b).v1))
+#define Vec2d_Max(a, b)    Vec2d_Make(Scalar_Max((a).v0, (b).v0), Scalar_Max((a).v1, (b).v1))
+#define Vec2d_Store(p, a)  ((p)[0] = (a).v0, (p)[1] = (a).v1)
+
+#endif
+
+#define Scalar_Add(a, b) ((a) + (b))
+#define Scalar_Min(a, b) ((b) < (a) ? (b) : (a))
+#define Scalar_Max(a, b) ((b) > (a) ? (b) : (a))
+
+/* element i as double, packed arrays and unpacked ones at the MJSDynamicType stride */
+#define Packed_Get(p, i) ((double)(p)[i])
+#define Int_Get(p, i)    ((double)(p)[i].value_int.value)
+#define Float_Get(p, i)  ((double)(p)[i].value_float.value)
+#define Double_Get(p, i) ((p)[i].value_double.value)
+
+#define Vec2d_LoadInt(p)           Vec2d_Set2(Int_Get(p, 0), Int_Get(p, 1))
+#define Vec2d_LoadFloatStrided(p)  Vec2d_Set2(Float_Get(p, 0), Float_Get(p, 1))
+#define Vec2d_LoadDoubleStrided(p) Vec2d_Set2(Double_Get(p, 0), Double_Get(p, 1))
+
+/*
+ float/double kernels, init is the identity of the operation
+*/
+#define MJS_REDUCE_KERNEL(name, elem_t, load, get, vec_op, scalar_op) \
+MJS_HOT static double name(const elem_t *p, unsigned int n, double init) { \
+ MJSVec2d a0 = Vec2d_Set1(init), a1 = a0, a2 = a0, a3 = a0; \
+ double lanes[2]; \
+ double r; \
+ unsigned int i = 0; \
+ for(; i + 8 <= n; i += 8) { \
+  a0 = vec_op(a0, load(&p[i])); \
+  a1 = vec_op(a1, load(&p[i + 2])); \
+  a2 = vec_op(a2, load(&p[i + 4])); \
+  a3 = vec_op(a3, load(&p[i + 6])); \
+ } \
+ a0 = vec_op(vec_op(a0, a1), vec_op(a2, a3)); \
+ Vec2d_Store(lanes, a0); \
+ r = scalar_op(lanes[0], lanes[1]); \
+ for(; i < n; i++) \
+  r = scalar_op(r, get(p, i)); \
+ return r; \
+}
+
+MJS_REDUCE_KERNEL(reduce_sum_double, double, Vec2d_Load, Packed_Get, Vec2d_Add, Scalar_Add)
+MJS_REDUCE_KERNEL(reduce_min_double, double, Vec2d_Load, Packed_Get, Vec2d_Min, Scalar_Min)
+MJS_REDUCE_KERNEL(reduce_max_double, double, Vec2d_Load, Packed_Get, Vec2d_Max, Scalar_Max)
+MJS_REDUCE_KERNEL(reduce_sum_float, float, Vec2d_LoadFloat, Packed_Get, Vec2d_Add, Scalar_Add)
+MJS_REDUCE_KERNEL(reduce_min_float, float, Vec2d_LoadFloat, Packed_Get, Vec2d_Min, Scalar_Min)
+MJS_REDUCE_KERNEL(reduce_max_float, float, Vec2d_LoadFloat, Packed_Get, Vec2d_Max, Scalar_Max)
+
+MJS_REDUCE_KERNEL(reduce_min_int_strided, MJSDynamicType, Vec2d_LoadInt, Int_Get, Vec2d_Min, Scalar_Min)
+MJS_REDUCE_KERNEL(reduce_max_int_strided, MJSDynamicType, Vec2d_LoadInt, Int_Get, Vec2d_Max, Scalar_Max)
+MJS_REDUCE_KERNEL(reduce_sum_float_strided, MJSDynamicType, Vec2d_LoadFloatStrided, Float_Get, Vec2d_Add, Scalar_Add)
+MJS_REDUCE_KERNEL(reduce_min_float_strided, MJSDynamicType, Vec2d_LoadFloatStrided, Float_Get, Vec2d_Min, Scalar_Min)
+MJS_REDUCE_KERNEL(reduce_max_float_strided, MJSDynamicType, Vec2d_LoadFloatStrided, Float_Get, Vec2d_Max, Scalar_Max)
+MJS_REDUCE_KERNEL(reduce_sum_double_strided, MJSDynamicType, Vec2d_LoadDoubleStrided, Double_Get, Vec2d_Add, Scalar_Add)
+MJS_REDUCE_KERNEL(reduce_min_double_strided, MJSDynamicType, Vec2d_LoadDoubleStrided, Double_Get, Vec2d_Min, Scalar_Min)
+MJS_REDUCE_KERNEL(reduce_max_double_strided, MJSDynamicType, Vec2d_LoadDoubleStrided, Double_Get, Vec2d_Max, Scalar_Max)
+
+#define MJS_DOT_KERNEL(name, elem_t, load) \
+MJS_HOT static double name(const elem_t *a, const elem_t *b, unsigned int n) { \
+ MJSVec2d a0 = Vec2d_Set1(0.0), a1 = a0, a2 = a0, a3 = a0; \
+ double lanes[2]; \
+ double r; \
+ unsigned int i = 0; \
+ for(; i + 8 <= n; i += 8) { \
+  a0 = Vec2d_Add(a0, Vec2d_Mul(load(&a[i]), load(&b[i]))); \
+  a1 = Vec2d_Add(a1, Vec2d_Mul(load(&a[i + 2]), load(&b[i + 2]))); \
+  a2 = Vec2d_Add(a2, Vec2d_Mul(load(&a[i + 4]), load(&b[i + 4]))); \
+  a3 = Vec2d_Add(a3, Vec2d_Mul(load(&a[i + 6]), load(&b[i + 6]))); \
+ } \
+ a0 = Vec2d_Add(Vec2d_Add(a0, a1), Vec2d_Add(a2, a3)); \
+ Vec2d_Store(lanes, a0); \
+ r = lanes[0] + lanes[1]; \
+ for(; i < n; i++) \
+  r += (double)a[i] * (double)b[i]; \
+ return r; \
+}
+
+MJS_DOT_KERNEL(reduce_dot_double, double, Vec2d_Load)
+MJS_DOT_KERNEL(reduce_dot_float, float, Vec2d_LoadFloat)
+
+/*
+ packed int64 kernels, plain 4 way unrolled so the compiler can vectorize
+ them where 64 bit compares exist, sum stays exact until the end.
+*/
+MJS_HOT static MJS_Int64 reduce_sum_int64(const MJS_Int64 *p, unsigned int n) {
+ MJS_Int64 a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+ unsigned int i = 0;
+ for(; i + 4 <= n; i += 4) {
+  a0 += p[i];
+  a1 += p[i + 1];
+  a2 += p[i + 2];
+  a3 += p[i + 3];
+ }
+ for(; i < n; i++)
+  a0 += p[i];
+ return (a0 + a1) + (a2 + a3);
+}
+
+MJS_HOT static MJS_Int64 reduce_minmax_int64(const MJS_Int64 *p, unsigned int n, int is_max) {
+ MJS_Int64 a0 = p[0], a1 = p[0], a2 = p[0], a3 = p[0];
+ unsigned int i = 0;
+ if(is_max) {
+  for(; i + 4 <= n; i += 4) {
+   a0 = Scalar_Max(a0, p[i]);
+   a1 = Scalar_Max(a1, p[i + 1]);
+   a2 = Scalar_Max(a2, p[i + 2]);
+   a3 = Scalar_Max(a3, p[i + 3]);
+  }
+  for(; i < n; i++)
+   a0 = Scalar_Max(a0, p[i]);
+  a0 = Scalar_Max(a0, a1);
+  a2 = Scalar_Max(a2, a3);
+  return Scalar_Max(a0, a2);
+ }
+ for(; i + 4 <= n; i += 4) {
+  a0 = Scalar_Min(a0, p[i]);
+  a1 = Scalar_Min(a1, p[i + 1]);
+  a2 = Scalar_Min(a2, p[i + 2]);
+  a3 = Scalar_Min(a3, p[i + 3]);
+ }
+ for(; i < n; i++)
+  a0 = Scalar_Min(a0, p[i]);
+ a0 = Scalar_Min(a0, a1);
+ a2 = Scalar_Min(a2, a3);
+ return Scalar_Min(a0, a2);
+}
+
+/* unpacked ints sum exact like the packed ones */
+MJS_HOT static MJS_Int64 reduce_sum_int_strided(const MJSDynamicType *p, unsigned int n) {
+ MJS_Int64 a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+ unsigned int i = 0;
+ for(; i + 4 <= n; i += 4) {
+  a0 += p[i].value_int.value;
+  a1 += p[i + 1].value_int.value;
+  a2 += p[i + 2].value_int.value;
+  a3 += p[i + 3].value_int.value;
+ }
+ for(; i < n; i++)
+  a0 += p[i].value_int.value;
+ return (a0 + a1) + (a2 + a3);
+}
+
+/*
+ type shared by every element of a non empty unpacked array, 0 if mixed
+*/
+MJS_INLINE unsigned char uniform_type(const MJSArray *arr) {
+ const MJSDynamicType *values = arr->dynamic_type_ptr;
+ unsigned char type = values[0].type, diff = 0;
+ unsigned int i;
+ for(i = 1; i < arr->size; i++)
+  diff |= values[i].type ^ type;
+ return diff ? 0 : type;
+}
+
+/*
+ read a number element as double, return 0 for other types
+*/
+MJS_INLINE int number_value(const MJSDynamicType *value, double *out) {
+ switch(value->type) {
+  case MJS_TYPE_NUMBER_INT:
+   *out = (double)value->value_int.value;
+   return 1;
+  case MJS_TYPE_NUMBER_FLOAT:
+   *out = (double)value->value_float.value;
+   return 1;
+  case MJS_TYPE_NUMBER_DOUBLE:
+   *out = value->value_double.value;
+   return 1;
+ }
+ return 0;
+}
+
+/*
+ sum of number elements and their count
+*/
+MJS_HOT static double reduce_sum(MJSArray *arr, unsigned int *out_count) {
+ const MJSDynamicType *values = arr->dynamic_type_ptr;
+ MJS_Int64 int_sum = 0;
+ double sum = 0.0;
+ unsigned int i, count = 0;
+
+ switch(arr->packed_type) {
+  case MJS_PACKED_INT64:
+   *out_count = arr->size;
+   return (double)reduce_sum_int64((const MJS_Int64*)values, arr->size);
+  case MJS_PACKED_FLOAT:
+   *out_count = arr->size;
+   return reduce_sum_float((const float*)values, arr->size, 0.0);
+  case MJS_PACKED_DOUBLE:
+   *out_count = arr->size;
+   return reduce_sum_double((const double*)values, arr->size, 0.0);
+  case MJS_PACKED_BOOLEAN:
+   *out_count = 0;
+   return 0.0;
+ }
+
+ if(arr->size) {
+  switch(uniform_type(arr)) {
+   case MJS_TYPE_NUMBER_INT:
+    *out_count = arr->size;
+    return (double)reduce_sum_int_strided(values, arr->size);
+   case MJS_TYPE_NUMBER_FLOAT:
+    *out_count = arr->size;
+    return reduce_sum_float_strided(values, arr->size, 0.0);
+   case MJS_TYPE_NUMBER_DOUBLE:
+    *out_count = arr->size;
+    return reduce_sum_double_strided(values, arr->size, 0.0);
+  }
+ }
+
+ /* ints are summed apart so they stay exact */
+ for(i = 0; i < arr->size; i++) {
+  switch(values[i].type) {
+   case MJS_TYPE_NUMBER_INT:
+    int_sum += values[i].value_int.value;
+    count++;
+   break;
+   case MJS_TYPE_NUMBER_FLOAT:
+    sum += (double)values[i].value_float.value;
+    count++;
+   break;
+   case MJS_TYPE_NUMBER_DOUBLE:
+    sum += values[i].value_double.value;
+    count++;
+   break;
+  }
+ }
+ *out_count = count;
+ return sum + (double)int_sum;
+}
+
+/*
+ min or max of number elements, return MJS_RESULT_INVALID_TYPE if there is none
+*/
+MJS_HOT static int reduce_minmax(MJSArray *arr, int is_max, double *out) {
+ const MJSDynamicType *values = arr->dynamic_type_ptr;
+ double r = is_max ? -DBL_MAX : DBL_MAX;
+ double number;
+ unsigned int i, count = 0;
+
+ if(arr->packed_type && arr->packed_type != MJS_PACKED_BOOLEAN) {
+  if(!arr->size)
+   return MJS_RESULT_INVALID_TYPE;
+  switch(arr->packed_type) {
+   case MJS_PACKED_INT64:
+    *out = (double)reduce_minmax_int64((const MJS_Int64*)values, arr->size, is_max);
+   break;
+   case MJS_PACKED_FLOAT:
+    *out = is_max ? reduce_max_float((const float*)values, arr->size, r) : reduce_min_float((const float*)values, arr->size, r);
+   break;
+   default:
+    *out = is_max ? reduce_max_double((const double*)values, arr->size, r) : reduce_min_double((const double*)values, arr->size, r);
+   break;
+  }
+  return 0;
+ }
+
+ if(arr->packed_type)
+  return MJS_RESULT_INVALID_TYPE;
+
+ if(arr->size) {
+  switch(uniform_type(arr)) {
+   case MJS_TYPE_NUMBER_INT:
+    *out = is_max ? reduce_max_int_strided(values, arr->size, r) : reduce_min_int_strided(values, arr->size, r);
+    return 0;
+   case MJS_TYPE_NUMBER_FLOAT:
+    *out = is_max ? reduce_max_float_strided(values, arr->size, r) : reduce_min_float_strided(values, arr->size, r);
+    return 0;
+   case MJS_TYPE_NUMBER_DOUBLE:
+    *out = is_max ? reduce_max_double_strided(values, arr->size, r) : reduce_min_double_strided(values, arr->size, r);
+    return 0;
+  }
+ }
+
+ for(i = 0; i < arr->size; i++) {
+  if(!number_value(&values[i], &number))
+   continue;
+  r = is_max ? Scalar_Max(r, number) : Scalar_Min(r, number);
+  count++;
+ }
+ if(!count)
+  return MJS_RESULT_INVALID_TYPE;
+ *out = r;
+ return 0;
+}
+
+/*-----------------Reduce func-------------------*/
+
+MJS_HOT int MJSArray_ReduceSum(MJSArray *arr, double *out_sum) {
+ unsigned int count;
+ if(MJS_Unlikely(!arr || !out_sum))
+  return MJS_RESULT_NULL_POINTER;
+ *out_sum = reduce_sum(arr, &count);
+ return 0;
+}
+
+
+MJS_HOT int MJSArray_ReduceMin(MJSArray *arr, double *out_min) {
+ if(MJS_Unlikely(!arr || !out_min))
+  return MJS_RESULT_NULL_POINTER;
+ return reduce_minmax(arr, 0, out_min);
+}
+
+
+MJS_HOT int MJSArray_ReduceMax(MJSArray *arr, double *out_max) {
+ if(MJS_Unlikely(!arr || !out_max))
+  return MJS_RESULT_NULL_POINTER;
+ return reduce_minmax(arr, 1, out_max);
+}
+
+
+MJS_HOT int MJSArray_ReduceMean(MJSArray *arr, double *out_mean) {
+ unsigned int count;
+ double sum;
+ if(MJS_Unlikely(!arr || !out_mean))
+  return MJS_RESULT_NULL_POINTER;
+ sum = reduce_sum(arr, &count);
+ if(!count)
+  return MJS_RESULT_INVALID_TYPE;
+ *out_mean = sum / (double)count;
+ return 0;
+}
+
+
+MJS_HOT int MJSArray_ReduceCountByType(MJSArray *arr, unsigned int out_counts[MJS_REDUCE_TYPE_SLOTS]) {
+ const MJSDynamicType *values;
+ unsigned int i;
+ if(MJS_Unlikely(!arr || !out_counts))
+  return MJS_RESULT_NULL_POINTER;
+
+ memset(out_counts, 0, sizeof(unsigned int) * MJS_REDUCE_TYPE_SLOTS);
+ switch(arr->packed_type) {
+  case MJS_PACKED_INT64:
+   out_counts[MJS_TYPE_NUMBER_INT] = arr->size;
+   return 0;
+  case MJS_PACKED_FLOAT:
+   out_counts[MJS_TYPE_NUMBER_FLOAT] = arr->size;
+   return 0;
+  case MJS_PACKED_DOUBLE:
+   out_counts[MJS_TYPE_NUMBER_DOUBLE] = arr->size;
+   return 0;
+  case MJS_PACKED_BOOLEAN:
+   out_counts[MJS_TYPE_BOOLEAN] = arr->size;
+   return 0;
+ }
+
+ values = arr->dynamic_type_ptr;
+ for(i = 0; i < arr->size; i++) {
+  if(values[i].type < MJS_REDUCE_TYPE_SLOTS)
+   out_counts[values[i].type]++;
+ }
+ return 0;
+}
+
+
+MJS_HOT int MJSArray_ReduceDot(MJSArray *a, MJSArray *b, double *out_dot) {
+ MJSDynamicType value_a, value_b;
+ double number_a, number_b, dot = 0.0;
+ unsigned int i;
+ if(MJS_Unlikely(!a || !b || !out_dot))
+  return MJS_RESULT_NULL_POINTER;
+ if(a->size != b->size)
+  return MJS_RESULT_INVALID_TYPE;
+
+ if(a->packed_type == b->packed_type) {
+  switch(a->packed_type) {
+   case MJS_PACKED_FLOAT:
+    *out_dot = reduce_dot_float((const float*)a->dynamic_type_ptr, (const float*)b->dynamic_type_ptr, a->size);
+    return 0;
+   case MJS_PACKED_DOUBLE:
+    *out_dot = reduce_dot_double((const double*)a->dynamic_type_ptr, (const double*)b->dynamic_type_ptr, a->size);
+    return 0;
+  }
+ }
+
+ for(i = 0; i < a->size; i++) {
+  MJSArray_GetValue_IMPL(a, i, &value_a);
+  MJSArray_GetValue_IMPL(b, i, &value_b);
+  if(!number_value(&value_a, &number_a) || !number_value(&value_b, &number_b))
+   return MJS_RESULT_INVALID_TYPE;
+  dot += number_a * number_b;
+ }
+ *out_dot = dot;
+ return 0;
+}
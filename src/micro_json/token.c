@@ -1,6 +1,7 @@
 #include "micro_json/token.h"
 #include "micro_json/parser.h"
 #include "micro_json/object_impl.h"
+#include "micro_json/profile.h"
 #include <string.h>
 
 #if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(MJS_FORCE_VECTORIZE)
@@ -19,7 +20,7 @@
 
 MJS_HOT static int read_json_object_first_value(MJSParsedData *parsed_data, MJSStringPool *pool, unsigned int depth);
 MJS_HOT static int read_json_object(MJSParsedData *parsed_data, MJSStringPool *pool, MJSObject *container, unsigned int depth);
-MJS_HOT static int read_json_object_value(MJSParsedData *parsed_data, MJSStringPool *pool, MJSObject *container, unsigned int pool_index, unsigned int str_size, unsigned short chunk_index, unsigned int depth);
+MJS_HOT static int read_json_object_value(MJSParsedData *parsed_data, MJSStringPool *pool, MJSObject *container, unsigned int pool_index, unsigned int str_size, unsigned int chunk_index, unsigned int depth);
 MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPool *pool, MJSArray *arr, unsigned int depth);
 
 #define _TRUE  "rue"
@@ -34,6 +35,49 @@ MJS_INLINE int fast_memcmp_4(const char *a, const char *b) {
  return a[0] != b[0] | a[1] != b[1] | a[2] != b[2] | a[3] != b[3];
 }
 
+/* only short values are worth a table probe */
+MJS_INLINE int intern_string_value(MJSStringPool *pool, MJSDynamicType *type) {
+ if(!(pool->options & MJS_POOL_INTERN_STRINGS) || type->value_string.str_size > MJS_MAX_INTERN_STRING_SIZE)
+  return 0;
+ return MJSStringPool_Intern_IMPL(pool, &type->value_string.pool_index, type->value_string.str_size, &type->value_string.chunk_index);
+}
+
+/*
+ large objects are only left unindexed when no duplicate key has to be
+ found while parsing, every other policy needs the index right away.
+*/
+MJS_INLINE int defer_index(MJSParsedData *parsed_data) {
+ return (parsed_data->options & MJS_PARSE_DEFER_INDEX) && parsed_data->duplicate_policy == MJS_DUPLICATE_KEY_NO_CHECK;
+}
+
+/*
+ add a parsed pair, deferred parses skip the index of large objects.
+ a value that was not stored is freed here.
+*/
+MJS_INLINE int insert_pair(MJSParsedData *parsed_data, MJSStringPool *pool, MJSObject *container, unsigned int pool_index, unsigned int str_size, unsigned int chunk_index, MJSDynamicType *value) {
+ int result = MJSObject_Append_IMPL(container, pool, pool_index, str_size, chunk_index, value, parsed_data->duplicate_policy, defer_index(parsed_data));
+ if(MJS_Unlikely(result))
+  destroy_value(value);
+ return result;
+}
+
+/*
+ containers are sized from the profile hints of their depth,
+ every array and object nests one level deeper than its parent
+*/
+MJS_INLINE int init_array(MJSParsedData *parsed_data, MJSStringPool *pool, MJSArray *arr, unsigned int depth) {
+ if(parsed_data->profile)
+  return MJSArray_InitReserve_IMPL(arr, pool, parsed_data->profile->levels[depth].array_size);
+ return MJSArray_Init_IMPL(arr, pool);
+}
+
+
+MJS_INLINE int init_object(MJSParsedData *parsed_data, MJSStringPool *pool, MJSObject *container, unsigned int depth) {
+ if(parsed_data->profile)
+  return MJSObject_InitReserve_IMPL(container, pool, parsed_data->profile->levels[depth].object_size, defer_index(parsed_data));
+ return MJSObject_Init_IMPL(container, pool);
+}
+
 /*-----------------Token func-------------------*/
 
 
@@ -51,8 +95,12 @@ MJS_HOT MJSTokenResult MJS_TokenParse(MJSParsedData *parsed_data, MJSStringPool
  parsed_data->current = str;
  parsed_data->end = str+len;
 
+ if(parsed_data->profile)
+  result.code = MJSParseProfile_Begin(parsed_data->profile, pool);
  result.code = result.code ? result.code : read_json_object_first_value(parsed_data, pool, 0);
  result.line = parsed_data->cl;
+ if(parsed_data->profile && !result.code)
+  result.code = MJSParseProfile_Learn(parsed_data->profile, pool);
  
  return result;
 }
@@ -93,6 +141,8 @@ MJS_HOT static int read_json_object_first_value(MJSParsedData *parsed_data, MJSS
     parsed_data->current++;
     parsed_data->container.type = MJS_TYPE_STRING;
     parsed_data->container.value_string.chunk_index = MJSStringPool_GetCurrentNode_IMPL(pool);
+    result = (parsed_data->container.value_string.chunk_index == 0xFFFFFFFF) * MJS_RESULT_ALLOCATION_FAILED;
+    if(MJS_Likely(!result))
     result = MJS_ParseStringToPool(parsed_data, &pool->root[parsed_data->container.value_string.chunk_index], &parsed_data->container.value_string.pool_index, &parsed_data->container.value_string.str_size);
    break;
    case '-': /* might be int or float */
@@ -111,13 +161,13 @@ MJS_HOT static int read_json_object_first_value(MJSParsedData *parsed_data, MJSS
    break;
    case '[': /* an array */
     parsed_data->current++;
-    result = MJSArray_Init_IMPL(&parsed_data->container.value_array);
+    result = init_array(parsed_data, pool, &parsed_data->container.value_array, depth+1);
     if(MJS_Likely(!result))
-    result = read_json_array_value(parsed_data, pool, &parsed_data->container.value_array, depth);
+    result = read_json_array_value(parsed_data, pool, &parsed_data->container.value_array, depth+1);
    break;
    case '{': /* an object */
     parsed_data->current++;
-    result = MJSObject_Init_IMPL(&parsed_data->container.value_object);
+    result = init_object(parsed_data, pool, &parsed_data->container.value_object, depth+1);
     if(MJS_Likely(!result))
     result = read_json_object(parsed_data, pool, &parsed_data->container.value_object, depth+1);
    break;
@@ -137,7 +187,7 @@ MJS_HOT static int read_json_object(MJSParsedData *parsed_data, MJSStringPool *p
 
  unsigned int pool_index_key = 0;
  unsigned int pool_str_size = 0;
- unsigned short pool_chunk_index = 0;
+ unsigned int pool_chunk_index = 0;
  
  signed char flags = _EXPECTED_FOR_NAME | _IS_EMPTY;
 
@@ -160,9 +210,11 @@ MJS_HOT static int read_json_object(MJSParsedData *parsed_data, MJSStringPool *p
     result = !(flags & _EXPECTED_FOR_NAME) * MJS_RESULT_SYNTAX_ERROR;
     parsed_data->current++;
     pool_chunk_index = MJSStringPool_GetCurrentNode_IMPL(pool);
-    result = result ? result : ((pool_chunk_index == 0xFFFF) * MJS_RESULT_ALLOCATION_FAILED);
+    result = result ? result : ((pool_chunk_index == 0xFFFFFFFF) * MJS_RESULT_ALLOCATION_FAILED);
     if(MJS_Likely(!result))
     result = MJS_ParseStringToPool(parsed_data, &pool->root[pool_chunk_index], &pool_index_key, &pool_str_size);
+    if(MJS_Likely(!result) && (pool->options & MJS_POOL_INTERN_KEYS))
+    result = MJSStringPool_Intern_IMPL(pool, &pool_index_key, pool_str_size, &pool_chunk_index);
     flags = _EXPECTED_FOR_VALUE;
     
    break;
@@ -181,7 +233,14 @@ MJS_HOT static int read_json_object(MJSParsedData *parsed_data, MJSStringPool *p
     
    break;
    case '}':
-    return !((flags & _HAS_VALUE) || (flags & _IS_EMPTY)) * MJS_RESULT_UNEXPECTED_TOKEN;
+    result = !((flags & _HAS_VALUE) || (flags & _IS_EMPTY)) * MJS_RESULT_UNEXPECTED_TOKEN;
+    if(!result && parsed_data->profile) {
+     parsed_data->profile->levels[depth].object_total += container->obj_pair_size;
+     parsed_data->profile->levels[depth].object_count++;
+    }
+    if(!result && (pool->options & MJS_POOL_SHARE_SHAPES))
+     result = MJSObject_Share_IMPL(container, pool);
+    return result;
    break;
    default:
     result = !MJS_IsWhiteSpace(*parsed_data->current) * MJS_RESULT_UNEXPECTED_TOKEN;
@@ -189,12 +248,12 @@ MJS_HOT static int read_json_object(MJSParsedData *parsed_data, MJSStringPool *p
   }
   parsed_data->current++;
  }
-  
- return 0;
+ /* an error from a pair, or an unclosed object */
+ return result ? result : MJS_RESULT_SYNTAX_ERROR;
 }
 
 
-MJS_HOT static int read_json_object_value(MJSParsedData *parsed_data, MJSStringPool *pool, MJSObject *container, unsigned int pool_index, unsigned int str_size, unsigned short chunk_index, unsigned int depth) {
+MJS_HOT static int read_json_object_value(MJSParsedData *parsed_data, MJSStringPool *pool, MJSObject *container, unsigned int pool_index, unsigned int str_size, unsigned int chunk_index, unsigned int depth) {
  MJSDynamicType dynamic_type;
  int result = 0;
  
@@ -211,7 +270,7 @@ MJS_HOT static int read_json_object_value(MJSParsedData *parsed_data, MJSStringP
     parsed_data->current += 2;
     dynamic_type.type = MJS_TYPE_BOOLEAN;
     dynamic_type.value_boolean.value = 1;
-    result = result ? result : MJSObject_InsertFromPool_IMPL(container, pool, pool_index, str_size, chunk_index, &dynamic_type);
+    result = result ? result : insert_pair(parsed_data, pool, container, pool_index, str_size, chunk_index, &dynamic_type);
     return result;
    break;
    case 'f': /* might be false */
@@ -219,24 +278,25 @@ MJS_HOT static int read_json_object_value(MJSParsedData *parsed_data, MJSStringP
     parsed_data->current += 3;
     dynamic_type.type = MJS_TYPE_BOOLEAN;
     dynamic_type.value_boolean.value = 0;
-    result = result ? result : MJSObject_InsertFromPool_IMPL(container, pool, pool_index, str_size, chunk_index, &dynamic_type);
+    result = result ? result : insert_pair(parsed_data, pool, container, pool_index, str_size, chunk_index, &dynamic_type);
     return result;
    break;
    case 'n': /* might be null */
     result = fast_memcmp_3(++parsed_data->current, _NULL) * MJS_RESULT_UNEXPECTED_TOKEN;
     parsed_data->current += 2;
     dynamic_type.type = MJS_TYPE_NULL;
-    result = result ? result : MJSObject_InsertFromPool_IMPL(container, pool, pool_index, str_size, chunk_index, &dynamic_type);
+    result = result ? result : insert_pair(parsed_data, pool, container, pool_index, str_size, chunk_index, &dynamic_type);
     return result;
    break;
    case '\"': /* string */
     parsed_data->current++;
     dynamic_type.type = MJS_TYPE_STRING;
     dynamic_type.value_string.chunk_index = MJSStringPool_GetCurrentNode(pool);
-    result = result ? result : ((dynamic_type.value_string.chunk_index == 0xFFFF) * MJS_RESULT_ALLOCATION_FAILED);
+    result = result ? result : ((dynamic_type.value_string.chunk_index == 0xFFFFFFFF) * MJS_RESULT_ALLOCATION_FAILED);
     if(MJS_Likely(!result))
     result = MJS_ParseStringToPool(parsed_data, &pool->root[dynamic_type.value_string.chunk_index], &dynamic_type.value_string.pool_index, &dynamic_type.value_string.str_size);
-    result = result ? result :  MJSObject_InsertFromPool_IMPL(container, pool, pool_index, str_size, chunk_index, &dynamic_type);
+    result = result ? result : intern_string_value(pool, &dynamic_type);
+    result = result ? result :  insert_pair(parsed_data, pool, container, pool_index, str_size, chunk_index, &dynamic_type);
     return result;
    break;
    case '-': /* might be int or float */
@@ -252,25 +312,29 @@ MJS_HOT static int read_json_object_value(MJSParsedData *parsed_data, MJSStringP
    case '8':
    case '9':
     result = MJS_ParseNumber(parsed_data, &dynamic_type);
-    result = result ? result : MJSObject_InsertFromPool_IMPL(container, pool, pool_index, str_size, chunk_index, &dynamic_type);
+    result = result ? result : insert_pair(parsed_data, pool, container, pool_index, str_size, chunk_index, &dynamic_type);
     return result;
    break;
    case '[': /* an array */
     parsed_data->current++;
-    result = MJSArray_Init_IMPL(&dynamic_type.value_array);
+    result = init_array(parsed_data, pool, &dynamic_type.value_array, depth+1);
     if(MJS_Likely(!result)) 
-    result = read_json_array_value(parsed_data, pool, &dynamic_type.value_array, depth);
+    result = read_json_array_value(parsed_data, pool, &dynamic_type.value_array, depth+1);
     if(MJS_Likely(!result))
-    result = MJSObject_InsertFromPool_IMPL(container, pool, pool_index, str_size, chunk_index, &dynamic_type);
+    result = insert_pair(parsed_data, pool, container, pool_index, str_size, chunk_index, &dynamic_type);
+    else if(dynamic_type.value_array.dynamic_type_ptr)
+    destroy_value(&dynamic_type);
     return result;
    break;
    case '{': /* an object */
     parsed_data->current++;
-    result = MJSObject_Init_IMPL(&dynamic_type.value_object);
+    result = init_object(parsed_data, pool, &dynamic_type.value_object, depth+1);
     if(MJS_Likely(!result))
     result = read_json_object(parsed_data, pool, &dynamic_type.value_object, depth+1);
     if(MJS_Likely(!result))
-    result = MJSObject_InsertFromPool_IMPL(container, pool, pool_index, str_size, chunk_index, &dynamic_type);
+    result = insert_pair(parsed_data, pool, container, pool_index, str_size, chunk_index, &dynamic_type);
+    else if(dynamic_type.value_object.obj_pair_ptr)
+    destroy_value(&dynamic_type);
     return result;
    break;
    default:
@@ -289,6 +353,10 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
  int result = 0;
  signed char flags = _EXPECTED_FOR_VALUE | _IS_EMPTY; 
  
+ /* without this, it might cause stack overflow */
+ if(MJS_Unlikely(depth >= MJS_MAX_NESTED_VALUE))
+  return MJS_RESULT_REACHED_MAX_NESTED_DEPTH;
+
  while(parsed_data->current < parsed_data->end && !result) {
 #if defined(MJS_NEON)
   Neon_read_json_array_value(parsed_data);
@@ -303,7 +371,7 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
     result = result ? result : fast_memcmp_3(++parsed_data->current, _NULL) * MJS_RESULT_UNEXPECTED_TOKEN;
     parsed_data->current += 2;
     dynamic_type.type = MJS_TYPE_NULL;
-    result = result ? result : MJSArray_Add_IMPL(arr, &dynamic_type);
+    result = result ? result : MJSArray_Add_IMPL(arr, pool, &dynamic_type);
     flags = _HAS_VALUE;
 
    break;
@@ -314,7 +382,7 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
     parsed_data->current += 2;
     dynamic_type.type = MJS_TYPE_BOOLEAN;
     dynamic_type.value_boolean.value = 1;
-    result = result ? result : MJSArray_Add_IMPL(arr, &dynamic_type);
+    result = result ? result : MJSArray_Add_IMPL(arr, pool, &dynamic_type);
     flags = _HAS_VALUE;
 
    break;
@@ -325,7 +393,7 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
     parsed_data->current += 3;
     dynamic_type.type = MJS_TYPE_BOOLEAN;
     dynamic_type.value_boolean.value = 0;
-    result = result ? result : MJSArray_Add_IMPL(arr, &dynamic_type);
+    result = result ? result : MJSArray_Add_IMPL(arr, pool, &dynamic_type);
     flags = _HAS_VALUE;
 
    break;
@@ -335,10 +403,11 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
     parsed_data->current++;
     dynamic_type.type = MJS_TYPE_STRING;
     dynamic_type.value_string.chunk_index = MJSStringPool_GetCurrentNode(pool);
-    result = result ? result : ((dynamic_type.value_string.chunk_index == 0xFFFF) * MJS_RESULT_ALLOCATION_FAILED);
+    result = result ? result : ((dynamic_type.value_string.chunk_index == 0xFFFFFFFF) * MJS_RESULT_ALLOCATION_FAILED);
     if(MJS_Likely(!result))
     result = MJS_ParseStringToPool(parsed_data, &pool->root[dynamic_type.value_string.chunk_index], &dynamic_type.value_string.pool_index, &dynamic_type.value_string.str_size);
-    result = result ? result : MJSArray_Add_IMPL(arr, &dynamic_type);
+    result = result ? result : intern_string_value(pool, &dynamic_type);
+    result = result ? result : MJSArray_Add_IMPL(arr, pool, &dynamic_type);
     flags = _HAS_VALUE;
     
    break;
@@ -357,7 +426,7 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
    
     result = !(flags & _EXPECTED_FOR_VALUE) * MJS_RESULT_UNEXPECTED_TOKEN;
     result = result ? result : MJS_ParseNumber(parsed_data, &dynamic_type);
-    result = result ? result : MJSArray_Add_IMPL(arr, &dynamic_type);
+    result = result ? result : MJSArray_Add_IMPL(arr, pool, &dynamic_type);
     flags = _HAS_VALUE;
  
    break;
@@ -365,11 +434,13 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
    
     result = !(flags & _EXPECTED_FOR_VALUE) * MJS_RESULT_UNEXPECTED_TOKEN;
     parsed_data->current++;
-    result = result ? result : MJSObject_Init_IMPL(&dynamic_type.value_object);
-    if(MJS_Likely(!result))
-    result = read_json_object(parsed_data, pool, &dynamic_type.value_object, depth+1);
-    if(MJS_Likely(!result))
-    result = MJSArray_Add_IMPL(arr, &dynamic_type);
+    result = result ? result : init_object(parsed_data, pool, &dynamic_type.value_object, depth+1);
+    if(MJS_Likely(!result)) {
+     result = read_json_object(parsed_data, pool, &dynamic_type.value_object, depth+1);
+     result = result ? result : MJSArray_Add_IMPL(arr, pool, &dynamic_type);
+     if(MJS_Unlikely(result))
+      destroy_value(&dynamic_type);
+    }
     flags = _HAS_VALUE;
 
    break;
@@ -377,17 +448,26 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
     
     result = !(flags & _EXPECTED_FOR_VALUE) * MJS_RESULT_UNEXPECTED_TOKEN;
     parsed_data->current++;    
-    result = result ? result : MJSArray_Init_IMPL(&dynamic_type.value_array);
-    if(MJS_Likely(!result))
-    result = read_json_array_value(parsed_data, pool, &dynamic_type.value_array, depth);
-    if(MJS_Likely(!result))
-    result = MJSArray_Add_IMPL(arr, &dynamic_type);
+    result = result ? result : init_array(parsed_data, pool, &dynamic_type.value_array, depth+1);
+    if(MJS_Likely(!result)) {
+     result = read_json_array_value(parsed_data, pool, &dynamic_type.value_array, depth+1);
+     result = result ? result : MJSArray_Add_IMPL(arr, pool, &dynamic_type);
+     if(MJS_Unlikely(result))
+      destroy_value(&dynamic_type);
+    }
     flags = _HAS_VALUE;
     
    break;
    case ']':
     /* excess comma */
-    return ((flags & _EXPECTED_FOR_VALUE) && !(flags & _IS_EMPTY)) * MJS_RESULT_UNEXPECTED_TOKEN;
+    result = ((flags & _EXPECTED_FOR_VALUE) && !(flags & _IS_EMPTY)) * MJS_RESULT_UNEXPECTED_TOKEN;
+    if(!result && parsed_data->profile) {
+     parsed_data->profile->levels[depth].array_total += arr->size;
+     parsed_data->profile->levels[depth].array_count++;
+    }
+    if(!result && (parsed_data->options & MJS_PARSE_PACK_ARRAYS))
+     result = MJSArray_Pack_IMPL(arr);
+    return result;
    break;
    case ',':
    
@@ -400,8 +480,8 @@ MJS_HOT static int read_json_array_value(MJSParsedData *parsed_data, MJSStringPo
   }
   parsed_data->current++;
  }
- /* unclosed array */
- return MJS_RESULT_UNEXPECTED_TOKEN;
+ /* an error from a value, or an unclosed array */
+ return result ? result : MJS_RESULT_UNEXPECTED_TOKEN;
 }
 
 
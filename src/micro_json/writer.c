@@ -1,23 +1,57 @@
 #include "micro_json/writer.h"
 #include "micro_json/parser.h"
 #include "micro_json/object_impl.h"
+#include "micro_json/number_format.h"
 #include <string.h>
 
 /*-----------------Static func decl-------------------*/
 
-MJS_HOT static int write_object(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSObject *obj, unsigned int depth);
-MJS_HOT static int write_value(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *value, unsigned int depth);
-MJS_HOT static int write_array(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSArray *arr, unsigned int depth);
-MJS_HOT static int indent(MJSOutputStreamBuffer *buff, unsigned int count);
+MJS_HOT static int write_string(MJSOutputStreamBuffer *buff, const char *str, unsigned int str_size, const MJSWriterOptions *options);
+MJS_HOT static int write_key(MJSOutputStreamBuffer *buff, const char *key, unsigned int key_size, const MJSWriterOptions *options);
+MJS_HOT static int write_scalar(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *value, const MJSWriterOptions *options);
+MJS_HOT static int write_packed_int64(MJSOutputStreamBuffer *buff, MJSArray *arr, const char *separator, unsigned int separator_size);
+MJS_HOT static int write_compact_object(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSObject *obj, unsigned int depth, const MJSWriterOptions *options);
+MJS_HOT static int write_compact_value(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *value, unsigned int depth, const MJSWriterOptions *options);
+MJS_HOT static int write_compact_array(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSArray *arr, unsigned int depth, const MJSWriterOptions *options);
+MJS_HOT static int write_object(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSObject *obj, unsigned int depth, const MJSWriterOptions *options);
+MJS_HOT static int write_value(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *value, unsigned int depth, const MJSWriterOptions *options);
+MJS_HOT static int write_array(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSArray *arr, unsigned int depth, const MJSWriterOptions *options);
+MJS_HOT static int new_line(MJSOutputStreamBuffer *buff, unsigned int depth, const MJSWriterOptions *options);
 
 /*-----------------Writer func-------------------*/
 
+MJS_COLD int MJSWriterOptions_Init(MJSWriterOptions *options) {
+ if(MJS_Unlikely(!options))
+  return MJS_RESULT_NULL_POINTER;
+ options->flags = 0;
+ options->indent_width = 1;
+ return 0;
+}
+
+
 MJS_COLD int MJSWriter_Serialize(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *container) {
- if(MJS_Unlikely(!buff || !container))
+ MJSWriterOptions options;
+ MJSWriterOptions_Init(&options);
+ return MJSWriter_SerializeWithOptions(buff, pool, container, &options);
+}
+
+
+MJS_COLD int MJSWriter_SerializeWithOptions(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *container, const MJSWriterOptions *options) {
+ if(MJS_Unlikely(!buff || !container || !options))
   return MJS_RESULT_NULL_POINTER;
  int result;
-  
- result = write_value(buff, pool, container, 0);
+
+ /* numbers are formatted straight into the cache, a few per write */
+ while(MJS_Unlikely(buff->cache_allocated_size < (MJS_NUMBER_TEXT_BYTES << 2))) {
+  result = MJSOutputStreamBuffer_ExpandCache(buff);
+  if(MJS_Unlikely(result))
+   return result;
+ }
+
+ if(options->flags & MJS_WRITER_COMPACT)
+  result = write_compact_value(buff, pool, container, 0, options);
+ else
+  result = write_value(buff, pool, container, 0, options);
  if(MJS_Unlikely(result))
   return result;
   
@@ -28,110 +62,87 @@ MJS_COLD int MJSWriter_Serialize(MJSOutputStreamBuffer *buff, MJSStringPool *poo
  return 0;
 }
 
-/*-----------------Static func-------------------*/
-
-MJS_HOT static int write_object(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSObject *obj, unsigned int depth) { 
- if(MJS_Unlikely(depth > MJS_MAX_NESTED_VALUE))
-  return MJS_RESULT_REACHED_MAX_NESTED_DEPTH;
-
- MJSObjectPair *pairs = obj->obj_pair_ptr;
+/*
+ serialize into a counting sink, numbers are still formatted for their
+ width but strings are only scanned. out_size leaves out the NUL.
+*/
+MJS_COLD int MJSWriter_MeasureSize(MJSStringPool *pool, MJSDynamicType *container, const MJSWriterOptions *options, unsigned int *out_size) {
+ if(MJS_Unlikely(!container || !options || !out_size))
+  return MJS_RESULT_NULL_POINTER;
+ MJSOutputStreamBuffer buff;
  int result;
- unsigned int i, iter;
- unsigned int estimated_size = obj->obj_pair_size + obj->reserve + MJS_MAX_HASH_BUCKETS;
- unsigned int total_size = 0;
 
- buff->cache[0] = '\n';
- result = MJSOutputStreamBuffer_Write(buff, buff->cache, 1);
+ *out_size = 0;
+ result = MJSOutputStreamBuffer_Init(&buff, MJS_WRITE_TO_COUNTER, NULL);
  if(MJS_Unlikely(result))
   return result;
+ result = MJSWriter_SerializeWithOptions(&buff, pool, container, options);
+ if(MJS_Likely(!result))
+  *out_size = buff.buff_size;
+ MJSOutputStreamBuffer_Destroy(&buff);
+ return result;
+}
 
- result = indent(buff, depth);
- if(MJS_Unlikely(result))
+/*-----------------Static func-------------------*/
+
+/*
+ quoted string value, gather output references long strings without
+ escapes where they sit in the pool, counting only sizes them
+*/
+MJS_HOT static int write_string(MJSOutputStreamBuffer *buff, const char *str, unsigned int str_size, const MJSWriterOptions *options) {
+ const int ascii_only = options->flags & MJS_WRITER_ASCII_ONLY;
+ int result;
+ if(buff->mode == MJS_WRITE_TO_COUNTER) {
+  buff->buff_size += MJS_StringEscapedSize(str, str_size, ascii_only);
+  return 0;
+ }
+ if(buff->mode == MJS_WRITE_TO_FD_GATHER && str_size >= MJS_MIN_GATHER_REF_BYTES && !MJS_StringNeedsEscape(str, str_size, ascii_only)) {
+  result = MJSOutputStreamBuffer_Write(buff, "\"", 1);
+  if(MJS_Likely(!result))
+   result = MJSOutputStreamBuffer_WriteRef(buff, str, str_size);
+  if(MJS_Likely(!result))
+   result = MJSOutputStreamBuffer_Write(buff, "\"", 1);
   return result;
- 
- result = MJSOutputStreamBuffer_Write(buff, "{\n", 2);
+ }
+ result = MJS_WriteStringToCache(buff, str, str_size, ascii_only);
  if(MJS_Unlikely(result))
   return result;
+ return MJSOutputStreamBuffer_Write(buff, buff->cache, buff->cache_size);
+}
 
- result = indent(buff, depth);
+/*
+ quoted key and its separator, compact output sends both in one write
+*/
+MJS_HOT static int write_key(MJSOutputStreamBuffer *buff, const char *key, unsigned int key_size, const MJSWriterOptions *options) {
+ int result = MJS_WriteStringToCache(buff, key, key_size, options->flags & MJS_WRITER_ASCII_ONLY);
  if(MJS_Unlikely(result))
   return result;
 
-
- /* check the size first */
- for(i = 0; i < estimated_size; i++) {
-  if(pairs[i].key_pool_size != 0xFFFFFFFF) {
-   total_size++;
-  }
+ if(!(options->flags & MJS_WRITER_COMPACT)) {
+  result = MJSOutputStreamBuffer_Write(buff, buff->cache, buff->cache_size);
+  if(MJS_Unlikely(result))
+   return result;
+  return MJSOutputStreamBuffer_Write(buff, " : ", 3);
  }
- 
- iter = 0;
- for(i = 0; i < estimated_size; i++) {
-  if(pairs[i].key_pool_size != 0xFFFFFFFF) {
-
-   MJSObjectPair m_pair = pairs[i];
-
-   result = MJS_WriteStringToCache(buff, &pool->root[m_pair.chunk_node_index].str[m_pair.key_pool_index], m_pair.key_pool_size);
-   if(MJS_Unlikely(result))
-    return result;
-
-   result = MJSOutputStreamBuffer_Write(buff, buff->cache, buff->cache_size);
-   if(MJS_Unlikely(result))
-    return result;
 
-   result = MJSOutputStreamBuffer_Write(buff, " : ", 3);
-   if(MJS_Unlikely(result))
-    return result;
-
-   result = write_value(buff, pool, &m_pair.value, depth);
+ if(MJS_Unlikely(buff->cache_size == buff->cache_allocated_size)) {
+  result = MJSOutputStreamBuffer_ExpandCache(buff);
   if(MJS_Unlikely(result))
-    return result;
-
-  if((iter+1) < total_size) {
-   buff->cache[0] = ',';
-   buff->cache[1] = '\n';
-   result = MJSOutputStreamBuffer_Write(buff, buff->cache, 2);
-   if(MJS_Unlikely(result))
-    return result;
-
-   result = indent(buff, depth);
-   if(MJS_Unlikely(result))
-    return result;
-
-  }
-  iter++;
-  }
-  
+   return result;
  }
- result = MJSOutputStreamBuffer_Write(buff, "\n", 1);
- if(MJS_Unlikely(result))
-  return result;
-
- result = indent(buff, depth);
- if(MJS_Unlikely(result))
-  return result;
-
- 
- buff->cache[0] = '}';
- result = MJSOutputStreamBuffer_Write(buff, buff->cache, 1);
- if(MJS_Unlikely(result))
-  return result;
-
-
- return 0;
+ buff->cache[buff->cache_size++] = ':';
+ return MJSOutputStreamBuffer_Write(buff, buff->cache, buff->cache_size);
 }
 
-
-
-MJS_HOT static int write_value(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *value, unsigned int depth) {
+/*
+ everything but objects and arrays, both styles write them the same
+*/
+MJS_HOT static int write_scalar(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *value, const MJSWriterOptions *options) {
  int result;
  switch(value->type) {
   case MJS_TYPE_STRING:
   
-   result = MJS_WriteStringToCache(buff, &pool->root[value->value_string.chunk_index].str[value->value_string.pool_index], value->value_string.str_size);
-   if(MJS_Unlikely(result))
-    return result;
-   result = MJSOutputStreamBuffer_Write(buff, buff->cache, buff->cache_size);
+   result = write_string(buff, &pool->root[value->value_string.chunk_index].str[value->value_string.pool_index], value->value_string.str_size, options);
    if(MJS_Unlikely(result))
     return result;
 
@@ -154,41 +165,24 @@ MJS_HOT static int write_value(MJSOutputStreamBuffer *buff, MJSStringPool *pool,
    if(MJS_Unlikely(result))
     return result;
       
-  break;
-  case MJS_TYPE_OBJECT:
-
-   result = write_object(buff, pool, &value->value_object, depth+1);
-   if(MJS_Unlikely(result))
-    return result;
- 
-  break;
-  case MJS_TYPE_ARRAY:
-
-   result = write_array(buff, pool, &value->value_array, depth+1);
-   if(MJS_Unlikely(result))
-    return result;
-
   break;
   case MJS_TYPE_NUMBER_INT:
 
-   sprintf(buff->cache, "%i", value->value_int.value);
-   result = MJSOutputStreamBuffer_Write(buff, buff->cache, strlen(buff->cache));
+   result = MJSOutputStreamBuffer_Write(buff, buff->cache, MJS_FormatInt32(value->value_int.value, buff->cache));
    if(MJS_Unlikely(result))
     return result;
 
   break;
   case MJS_TYPE_NUMBER_FLOAT:
 
-   sprintf(buff->cache, "%.6f", value->value_float.value);
-   result = MJSOutputStreamBuffer_Write(buff, buff->cache, strlen(buff->cache));
+   result = MJSOutputStreamBuffer_Write(buff, buff->cache, MJS_FormatFloat(value->value_float.value, buff->cache));
    if(MJS_Unlikely(result))
     return result;
 
   break;
   case MJS_TYPE_NUMBER_DOUBLE:
 
-   sprintf(buff->cache, "%.15f", value->value_double.value);
-   result = MJSOutputStreamBuffer_Write(buff, buff->cache, strlen(buff->cache));
+   result = MJSOutputStreamBuffer_Write(buff, buff->cache, MJS_FormatDouble(value->value_double.value, buff->cache));
    if(MJS_Unlikely(result))
     return result;
 
@@ -203,9 +197,204 @@ MJS_HOT static int write_value(MJSOutputStreamBuffer *buff, MJSStringPool *pool,
  return 0;
 }
 
+/*
+ packed integers skip the per value round trip, they are formatted
+ into the cache back to back and written when it fills up
+*/
+MJS_HOT static int write_packed_int64(MJSOutputStreamBuffer *buff, MJSArray *arr, const char *separator, unsigned int separator_size) {
+ const MJS_Int64 *values = (const MJS_Int64*)arr->dynamic_type_ptr;
+ const unsigned int limit = buff->cache_allocated_size - MJS_NUMBER_TEXT_BYTES - separator_size;
+ unsigned int i;
+ unsigned int size = 0;
+ int result;
+
+ for(i = 0; i < arr->size; i++) {
+  if(MJS_Unlikely(size > limit)) {
+   result = MJSOutputStreamBuffer_Write(buff, buff->cache, size);
+   if(MJS_Unlikely(result))
+    return result;
+   size = 0;
+  }
+  if(i) {
+   memcpy(&buff->cache[size], separator, separator_size);
+   size += separator_size;
+  }
+  size += MJS_FormatInt64(values[i], &buff->cache[size]);
+ }
+ return MJSOutputStreamBuffer_Write(buff, buff->cache, size);
+}
+
+/*-----------------Compact-------------------*/
+
+MJS_HOT static int write_compact_object(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSObject *obj, unsigned int depth, const MJSWriterOptions *options) {
+ if(MJS_Unlikely(depth > MJS_MAX_NESTED_VALUE))
+  return MJS_RESULT_REACHED_MAX_NESTED_DEPTH;
+
+ MJSDynamicType *value;
+ MJSShapeKey key;
+ int result;
+ unsigned int i;
+ const unsigned int total_size = MJSObject_SlotCount_IMPL(obj);
+
+ result = MJSOutputStreamBuffer_Write(buff, "{", 1);
+ if(MJS_Unlikely(result))
+  return result;
+
+ for(i = 0; i < total_size; i++) {
+  value = MJSObject_SlotAt_IMPL(obj, i, &key);
+
+  result = write_key(buff, &pool->root[key.chunk_node_index].str[key.key_pool_index], key.key_pool_size, options);
+  if(MJS_Unlikely(result))
+   return result;
+
+  result = write_compact_value(buff, pool, value, depth, options);
+  if(MJS_Unlikely(result))
+   return result;
+
+  if((i+1) < total_size) {
+   result = MJSOutputStreamBuffer_Write(buff, ",", 1);
+   if(MJS_Unlikely(result))
+    return result;
+  }
+ }
+
+ result = MJSOutputStreamBuffer_Write(buff, "}", 1);
+ if(MJS_Unlikely(result))
+  return result;
+ return 0;
+}
+
+
+
+MJS_HOT static int write_compact_value(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *value, unsigned int depth, const MJSWriterOptions *options) {
+ switch(value->type) {
+  case MJS_TYPE_OBJECT:
+   return write_compact_object(buff, pool, &value->value_object, depth+1, options);
+  case MJS_TYPE_ARRAY:
+   return write_compact_array(buff, pool, &value->value_array, depth+1, options);
+  default:
+   return write_scalar(buff, pool, value, options);
+ }
+}
+
+
+
+MJS_HOT static int write_compact_array(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSArray *arr, unsigned int depth, const MJSWriterOptions *options) {
+ int result;
+ unsigned int i;
+ const unsigned int arr_size = arr->size;
+ MJSDynamicType packed_value;
+ MJSDynamicType *curr_obj;
+
+ result = MJSOutputStreamBuffer_Write(buff, "[", 1);
+ if(MJS_Unlikely(result))
+  return result;
+
+ if(arr->packed_type == MJS_PACKED_INT64) {
+  result = write_packed_int64(buff, arr, ",", 1);
+  if(MJS_Unlikely(result))
+   return result;
+  return MJSOutputStreamBuffer_Write(buff, "]", 1);
+ }
+
+ for(i = 0; i < arr_size; i++) {
+  if(arr->packed_type) {
+   MJSArray_GetValue_IMPL(arr, i, &packed_value);
+   curr_obj = &packed_value;
+  } else {
+   curr_obj = &arr->dynamic_type_ptr[i];
+  }
+  result = write_compact_value(buff, pool, curr_obj, depth, options);
+  if(MJS_Unlikely(result))
+   return result;
+
+  if((i+1) < arr_size) {
+   result = MJSOutputStreamBuffer_Write(buff, ",", 1);
+   if(MJS_Unlikely(result))
+    return result;
+  }
+ }
+
+ result = MJSOutputStreamBuffer_Write(buff, "]", 1);
+ if(MJS_Unlikely(result))
+  return result;
+ return 0;
+}
+
+/*-----------------Pretty-------------------*/
+
+MJS_HOT static int write_object(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSObject *obj, unsigned int depth, const MJSWriterOptions *options) { 
+ if(MJS_Unlikely(depth > MJS_MAX_NESTED_VALUE))
+  return MJS_RESULT_REACHED_MAX_NESTED_DEPTH;
+
+ MJSDynamicType *value;
+ MJSShapeKey key;
+ int result;
+ unsigned int i;
+ const unsigned int total_size = MJSObject_SlotCount_IMPL(obj);
+
+ result = new_line(buff, depth, options);
+ if(MJS_Unlikely(result))
+  return result;
+ 
+ result = MJSOutputStreamBuffer_Write(buff, "{", 1);
+ if(MJS_Unlikely(result))
+  return result;
+
+ result = new_line(buff, depth, options);
+ if(MJS_Unlikely(result))
+  return result;
+
+ /* pairs are dense and in document order */
+ for(i = 0; i < total_size; i++) {
+  value = MJSObject_SlotAt_IMPL(obj, i, &key);
+
+  result = write_key(buff, &pool->root[key.chunk_node_index].str[key.key_pool_index], key.key_pool_size, options);
+  if(MJS_Unlikely(result))
+   return result;
+
+  result = write_value(buff, pool, value, depth, options);
+  if(MJS_Unlikely(result))
+   return result;
+
+  if((i+1) < total_size) {
+   result = MJSOutputStreamBuffer_Write(buff, ",", 1);
+   if(MJS_Unlikely(result))
+    return result;
+
+   result = new_line(buff, depth, options);
+   if(MJS_Unlikely(result))
+    return result;
+  }
+ }
+ result = new_line(buff, depth, options);
+ if(MJS_Unlikely(result))
+  return result;
+
+ result = MJSOutputStreamBuffer_Write(buff, "}", 1);
+ if(MJS_Unlikely(result))
+  return result;
+
+
+ return 0;
+}
+
 
 
-MJS_HOT static int write_array(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSArray *arr, unsigned int depth) {
+MJS_HOT static int write_value(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSDynamicType *value, unsigned int depth, const MJSWriterOptions *options) {
+ switch(value->type) {
+  case MJS_TYPE_OBJECT:
+   return write_object(buff, pool, &value->value_object, depth+1, options);
+  case MJS_TYPE_ARRAY:
+   return write_array(buff, pool, &value->value_array, depth+1, options);
+  default:
+   return write_scalar(buff, pool, value, options);
+ }
+}
+
+
+
+MJS_HOT static int write_array(MJSOutputStreamBuffer *buff, MJSStringPool *pool, MJSArray *arr, unsigned int depth, const MJSWriterOptions *options) {
  int result;
  unsigned int i;
  unsigned int arr_size = MJSArray_Size(arr);
@@ -213,10 +402,22 @@ MJS_HOT static int write_array(MJSOutputStreamBuffer *buff, MJSStringPool *pool,
  result = MJSOutputStreamBuffer_Write(buff, "[", 1);
  if(MJS_Unlikely(result))
   return result;
+
+ if(arr->packed_type == MJS_PACKED_INT64) {
+  result = write_packed_int64(buff, arr, ", ", 2);
+  if(MJS_Unlikely(result))
+   return result;
+  return MJSOutputStreamBuffer_Write(buff, "]", 1);
+ }
   
+ MJSDynamicType packed_value;
  for(i = 0; i < arr_size; i++) {
   MJSDynamicType *curr_obj = MJSArray_Get(arr, i);
-  result = write_value(buff, pool, curr_obj, depth);
+  if(arr->packed_type) {
+   MJSArray_GetValue_IMPL(arr, i, &packed_value);
+   curr_obj = &packed_value;
+  }
+  result = write_value(buff, pool, curr_obj, depth, options);
   if(MJS_Unlikely(result))
    return result;
   
@@ -227,32 +428,260 @@ MJS_HOT static int write_array(MJSOutputStreamBuffer *buff, MJSStringPool *pool,
   }
  
   if(curr_obj->type == MJS_TYPE_OBJECT) {
-   result = MJSOutputStreamBuffer_Write(buff, "\n", 1);
+   result = new_line(buff, depth, options);
    if(MJS_Unlikely(result))
     return result;
+  }
+ }
+
+ result = MJSOutputStreamBuffer_Write(buff, "]", 1);
+ if(MJS_Unlikely(result))
+  return result;
+ return 0;
+}
+
 
+/*
+ line break plus the indent of depth, in one write
+*/
+MJS_HOT static int new_line(MJSOutputStreamBuffer *buff, unsigned int depth, const MJSWriterOptions *options) {
+ int result;
+ unsigned int size = 0;
+ const unsigned int count = depth * options->indent_width;
 
-  result = indent(buff, depth);
+ while(MJS_Unlikely(count + 2 > buff->cache_allocated_size)) {
+  result = MJSOutputStreamBuffer_ExpandCache(buff);
   if(MJS_Unlikely(result))
    return result;
+ }
+ if(options->flags & MJS_WRITER_CRLF)
+  buff->cache[size++] = '\r';
+ buff->cache[size++] = '\n';
+ memset(&buff->cache[size], ' ', count);
+ return MJSOutputStreamBuffer_Write(buff, buff->cache, size + count);
+}
 
-  }
+/*-----------------Streaming-------------------*/
+
+/* levels[] bits, levels[0] holds the root value */
+#define MJS_LEVEL_OBJECT    1
+#define MJS_LEVEL_HAS_ITEMS 2
+#define MJS_LEVEL_AFTER_KEY 4
+#define MJS_LEVEL_NEW_LINE  8 /* pretty arrays break the line after an object */
+
+MJS_COLD int MJSWriter_Init(MJSWriter *writer, MJSOutputStreamBuffer *buff, const MJSWriterOptions *options) {
+ if(MJS_Unlikely(!writer || !buff))
+  return MJS_RESULT_NULL_POINTER;
+ int result;
+
+ writer->buff = buff;
+ if(options)
+  writer->options = *options;
+ else
+  MJSWriterOptions_Init(&writer->options);
+ writer->depth = 0;
+ writer->levels[0] = 0;
+
+ while(MJS_Unlikely(buff->cache_allocated_size < (MJS_NUMBER_TEXT_BYTES << 2))) {
+  result = MJSOutputStreamBuffer_ExpandCache(buff);
+  if(MJS_Unlikely(result))
+   return result;
  }
+ return 0;
+}
 
- result = MJSOutputStreamBuffer_Write(buff, "]", 1);
+/*
+ check a value may go here and write what the level owes before it
+*/
+MJS_HOT static int stream_value(MJSWriter *writer) {
+ unsigned char *level = &writer->levels[writer->depth];
+ int result;
+
+ if(*level & MJS_LEVEL_OBJECT) {
+  if(MJS_Unlikely(!(*level & MJS_LEVEL_AFTER_KEY)))
+   return MJS_RESULT_UNEXPECTED_TOKEN;
+  *level &= ~MJS_LEVEL_AFTER_KEY;
+  return 0;
+ }
+ if(!writer->depth) {
+  if(MJS_Unlikely(*level & MJS_LEVEL_HAS_ITEMS))
+   return MJS_RESULT_UNEXPECTED_TOKEN;
+  *level |= MJS_LEVEL_HAS_ITEMS;
+  return 0;
+ }
+
+ if(*level & MJS_LEVEL_HAS_ITEMS) {
+  if(writer->options.flags & MJS_WRITER_COMPACT)
+   result = MJSOutputStreamBuffer_Write(writer->buff, ",", 1);
+  else
+   result = MJSOutputStreamBuffer_Write(writer->buff, ", ", 2);
+  if(MJS_Unlikely(result))
+   return result;
+ }
+ if(*level & MJS_LEVEL_NEW_LINE) {
+  result = new_line(writer->buff, writer->depth, &writer->options);
+  if(MJS_Unlikely(result))
+   return result;
+ }
+ *level = (unsigned char)((*level | MJS_LEVEL_HAS_ITEMS) & ~MJS_LEVEL_NEW_LINE);
+ return 0;
+}
+
+
+MJS_HOT int MJSWriter_BeginObject(MJSWriter *writer) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ if(MJS_Unlikely(writer->depth >= MJS_MAX_NESTED_VALUE))
+  return MJS_RESULT_REACHED_MAX_NESTED_DEPTH;
+ int result = stream_value(writer);
  if(MJS_Unlikely(result))
   return result;
- return 0;
+ writer->levels[++writer->depth] = MJS_LEVEL_OBJECT;
+
+ if(writer->options.flags & MJS_WRITER_COMPACT)
+  return MJSOutputStreamBuffer_Write(writer->buff, "{", 1);
+ result = new_line(writer->buff, writer->depth, &writer->options);
+ if(MJS_Unlikely(result))
+  return result;
+ result = MJSOutputStreamBuffer_Write(writer->buff, "{", 1);
+ if(MJS_Unlikely(result))
+  return result;
+ return new_line(writer->buff, writer->depth, &writer->options);
 }
 
 
+MJS_HOT int MJSWriter_EndObject(MJSWriter *writer) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ const unsigned char level = writer->levels[writer->depth];
+ const int pretty = !(writer->options.flags & MJS_WRITER_COMPACT);
+ int result;
 
-MJS_HOT static int indent(MJSOutputStreamBuffer *buff, unsigned int count) {
- memset(buff->cache, ' ', count);
- int result = MJSOutputStreamBuffer_Write(buff, buff->cache, count);
+ if(MJS_Unlikely(!writer->depth || !(level & MJS_LEVEL_OBJECT) || (level & MJS_LEVEL_AFTER_KEY)))
+  return MJS_RESULT_UNEXPECTED_TOKEN;
+ if(pretty) {
+  result = new_line(writer->buff, writer->depth, &writer->options);
+  if(MJS_Unlikely(result))
+   return result;
+ }
+ result = MJSOutputStreamBuffer_Write(writer->buff, "}", 1);
  if(MJS_Unlikely(result))
   return result;
+
+ writer->depth--;
+ if(pretty && writer->depth && !(writer->levels[writer->depth] & MJS_LEVEL_OBJECT))
+  writer->levels[writer->depth] |= MJS_LEVEL_NEW_LINE;
  return 0;
 }
 
 
+MJS_HOT int MJSWriter_BeginArray(MJSWriter *writer) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ if(MJS_Unlikely(writer->depth >= MJS_MAX_NESTED_VALUE))
+  return MJS_RESULT_REACHED_MAX_NESTED_DEPTH;
+ int result = stream_value(writer);
+ if(MJS_Unlikely(result))
+  return result;
+ writer->levels[++writer->depth] = 0;
+ return MJSOutputStreamBuffer_Write(writer->buff, "[", 1);
+}
+
+
+MJS_HOT int MJSWriter_EndArray(MJSWriter *writer) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ const unsigned char level = writer->levels[writer->depth];
+ int result;
+
+ if(MJS_Unlikely(!writer->depth || (level & MJS_LEVEL_OBJECT)))
+  return MJS_RESULT_UNEXPECTED_TOKEN;
+ if(level & MJS_LEVEL_NEW_LINE) {
+  result = new_line(writer->buff, writer->depth, &writer->options);
+  if(MJS_Unlikely(result))
+   return result;
+ }
+ writer->depth--;
+ return MJSOutputStreamBuffer_Write(writer->buff, "]", 1);
+}
+
+
+MJS_HOT int MJSWriter_Key(MJSWriter *writer, const char *key, unsigned int key_size) {
+ if(MJS_Unlikely(!writer || !key))
+  return MJS_RESULT_NULL_POINTER;
+ unsigned char *level = &writer->levels[writer->depth];
+ int result;
+
+ if(MJS_Unlikely(!writer->depth || !(*level & MJS_LEVEL_OBJECT) || (*level & MJS_LEVEL_AFTER_KEY)))
+  return MJS_RESULT_UNEXPECTED_TOKEN;
+ if(*level & MJS_LEVEL_HAS_ITEMS) {
+  result = MJSOutputStreamBuffer_Write(writer->buff, ",", 1);
+  if(MJS_Likely(!result) && !(writer->options.flags & MJS_WRITER_COMPACT))
+   result = new_line(writer->buff, writer->depth, &writer->options);
+  if(MJS_Unlikely(result))
+   return result;
+ }
+ *level |= MJS_LEVEL_HAS_ITEMS | MJS_LEVEL_AFTER_KEY;
+ return write_key(writer->buff, key, key_size, &writer->options);
+}
+
+
+MJS_HOT int MJSWriter_String(MJSWriter *writer, const char *str, unsigned int str_size) {
+ if(MJS_Unlikely(!writer || !str))
+  return MJS_RESULT_NULL_POINTER;
+ int result = stream_value(writer);
+ if(MJS_Unlikely(result))
+  return result;
+ return write_string(writer->buff, str, str_size, &writer->options);
+}
+
+
+MJS_HOT int MJSWriter_Int(MJSWriter *writer, MJS_Int64 value) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ int result = stream_value(writer);
+ if(MJS_Unlikely(result))
+  return result;
+ return MJSOutputStreamBuffer_Write(writer->buff, writer->buff->cache, MJS_FormatInt64(value, writer->buff->cache));
+}
+
+
+MJS_HOT int MJSWriter_Double(MJSWriter *writer, double value) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ int result = stream_value(writer);
+ if(MJS_Unlikely(result))
+  return result;
+ return MJSOutputStreamBuffer_Write(writer->buff, writer->buff->cache, MJS_FormatDouble(value, writer->buff->cache));
+}
+
+
+MJS_HOT int MJSWriter_Boolean(MJSWriter *writer, int value) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ int result = stream_value(writer);
+ if(MJS_Unlikely(result))
+  return result;
+ if(value)
+  return MJSOutputStreamBuffer_Write(writer->buff, "true", 4);
+ return MJSOutputStreamBuffer_Write(writer->buff, "false", 5);
+}
+
+
+MJS_HOT int MJSWriter_Null(MJSWriter *writer) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ int result = stream_value(writer);
+ if(MJS_Unlikely(result))
+  return result;
+ return MJSOutputStreamBuffer_Write(writer->buff, "null", 4);
+}
+
+
+MJS_COLD int MJSWriter_Finish(MJSWriter *writer) {
+ if(MJS_Unlikely(!writer))
+  return MJS_RESULT_NULL_POINTER;
+ if(MJS_Unlikely(writer->depth || !(writer->levels[0] & MJS_LEVEL_HAS_ITEMS)))
+  return MJS_RESULT_UNEXPECTED_TOKEN;
+ return MJSOutputStreamBuffer_Flush(writer->buff);
+}